@@ -3,7 +3,7 @@
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
 #include "hardware/gpio.h"
-#include "pico/util/queue.h"
+#include "../lab4/typed_queue.h"
 
 // Define GPIO pins
 #define LED1 20
@@ -22,7 +22,8 @@ typedef enum {
     EVENT_CCW
 } encoder_event_t;
 
-queue_t encoder_queue;  // Queue to store encoder events
+TYPED_QUEUE(encoder_queue, encoder_event_t, 16)
+encoder_queue_t encoder_queue;  // Lock-free queue to store encoder events (ISR -> main loop)
 
 // Function to initialize PWM on a pin
 void setup_pwm_pin(uint pin) {
@@ -48,10 +49,10 @@ void encoder_callback(uint gpio, uint32_t events) {
         encoder_event_t event;
         if (gpio == ROT_LEFT && rot_right_state == true) {
             event = EVENT_CCW;
-            queue_try_add(&encoder_queue, &event);
+            encoder_queue_try_add(&encoder_queue, &event);
         } else if (gpio == ROT_RIGHT && rot_left_state == true) {
             event = EVENT_CW;
-            queue_try_add(&encoder_queue, &event);
+            encoder_queue_try_add(&encoder_queue, &event);
         }
     }
 }
@@ -77,7 +78,7 @@ void setup() {
     setup_pwm_pin(LED3);
 
     // Initialize the encoder event queue
-    queue_init(&encoder_queue, sizeof(encoder_event_t), 10);
+    encoder_queue_init(&encoder_queue);
 
     // Attach interrupt handlers for encoder pins
     gpio_set_irq_enabled_with_callback(ROT_LEFT, GPIO_IRQ_EDGE_FALL, true, &encoder_callback);
@@ -111,8 +112,10 @@ int main(void) {
 
         // Process encoder events from the queue
         if (led_state) {
-            encoder_event_t event;
-            while (queue_try_remove(&encoder_queue, &event)) {
+            encoder_event_t events[16];
+            int count = encoder_queue_remove_batch(&encoder_queue, events, 16); // Take all pending events at once
+            for (int i = 0; i < count; i++) {
+                encoder_event_t event = events[i];
                 if (event == EVENT_CW) {
                     brightness += 100;
                     if (brightness > 1000) brightness = 1000;
@@ -0,0 +1,108 @@
+//
+// Non-blocking AT command engine: queued commands, response matching, timeouts, callbacks.
+//
+#include <string.h>
+#include "uart.h"
+#include "at_engine.h"
+
+void at_init(at_engine *at, int uart_nr, at_line_handler unsolicited, void *context)
+{
+    memset(at, 0, sizeof(*at));
+    at->uart_nr = uart_nr;
+    at_queue_init(&at->queue);
+    at->unsolicited = unsolicited;
+    at->context = context;
+}
+
+bool at_submit(at_engine *at, const at_request *request)
+{
+    at_pending p;
+    size_t len = strlen(request->command);
+    if(len >= sizeof(p.command)) return false;
+    p.request = *request;
+    memcpy(p.command, request->command, len + 1);
+    return at_queue_try_add(&at->queue, &p);
+}
+
+bool at_idle(at_engine *at)
+{
+    return !at->active && at_queue_count(&at->queue) == 0;
+}
+
+static void at_send(at_engine *at, uint64_t now_us)
+{
+    uart_send(at->uart_nr, at->current.command);
+    at->sent = true;
+    ++at->attempts;
+    at->sent_us = now_us;
+    at->due_us = now_us + at->current.request.timeout_us;
+}
+
+// does line answer the command in flight
+static bool at_match(const at_request *r, const char *line, at_result *result)
+{
+    if(strncmp(line, "ERROR", 5) == 0 || strncmp(line, "+CME ERROR", 10) == 0) {
+        *result = AT_ERROR;
+        return true;
+    }
+    if(r->prefix) {
+        if(strncmp(line, r->prefix, strlen(r->prefix)) != 0) return false;
+        *result = strstr(line, "ERROR") ? AT_ERROR : AT_OK;
+        return true;
+    }
+    if(strcmp(line, "OK") == 0) {
+        *result = AT_OK;
+        return true;
+    }
+    return false;
+}
+
+static void at_complete(at_engine *at, at_result result, int length, uint64_t line_us)
+{
+    at_response response = { result, at->line, length, 0, at->attempts };
+    // a late answer to an earlier attempt can predate the last send
+    if(result != AT_TIMEOUT && line_us > at->sent_us) response.latency_us = (uint32_t) (line_us - at->sent_us);
+    if(result == AT_OK) ++at->completed;
+    else if(result == AT_ERROR) ++at->errors;
+    else ++at->timeouts;
+    at->active = false;
+    if(at->current.request.done) at->current.request.done(at->current.request.context, &response);
+}
+
+void at_poll(at_engine *at, uint64_t now_us)
+{
+    uint64_t line_us;
+    int len;
+    at_result result;
+
+    // answers first: one that arrived in time counts even if we look after the timeout
+    while((len = uart_read_line(at->uart_nr, (uint8_t *) at->line, sizeof(at->line), 0, &line_us)) >= 0) {
+        while(len > 0 && (at->line[len - 1] == '\n' || at->line[len - 1] == '\r')) at->line[--len] = '\0';
+        if(len == 0) continue;
+        if(at->active && at->sent && at_match(&at->current.request, at->line, &result)) {
+            at_complete(at, result, len, line_us);
+        } else {
+            ++at->unsolicited_lines;
+            if(at->unsolicited) at->unsolicited(at->context, at->line, len);
+        }
+    }
+
+    if(at->active && (int64_t) (now_us - at->due_us) >= 0) {
+        int attempts = at->current.request.attempts > 0 ? at->current.request.attempts : 1;
+        if(!at->sent || at->attempts < attempts) {
+            at_send(at, now_us);
+        } else {
+            at->line[0] = '\0';
+            at_complete(at, AT_TIMEOUT, 0, 0);
+        }
+    }
+
+    // the callback above may have queued the next command
+    if(!at->active && at_queue_try_remove(&at->queue, &at->current)) {
+        at->active = true;
+        at->sent = false;
+        at->attempts = 0;
+        at->due_us = now_us + at->current.request.delay_us;
+        if(at->current.request.delay_us == 0) at_send(at, now_us);
+    }
+}
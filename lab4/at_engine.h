@@ -0,0 +1,89 @@
+//
+// Non-blocking AT command engine: queued commands, response matching, timeouts, callbacks.
+//
+
+#ifndef UART_IRQ_AT_ENGINE_H
+#define UART_IRQ_AT_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "typed_queue.h"
+
+// commands waiting behind the one in flight, must be a power of two
+#ifndef AT_QUEUE_SIZE
+#define AT_QUEUE_SIZE 8
+#endif
+#ifndef AT_COMMAND_MAX
+#define AT_COMMAND_MAX 32
+#endif
+#ifndef AT_LINE_MAX
+#define AT_LINE_MAX 80
+#endif
+
+typedef enum {
+    AT_OK,
+    AT_ERROR,       // the module answered with an error
+    AT_TIMEOUT,     // no answer after the last attempt
+} at_result;
+
+typedef struct {
+    at_result result;
+    const char *line;       // the answer without CR/LF, "" after a timeout; valid during the callback
+    int length;
+    uint32_t latency_us;    // from sending the command to the answer's arrival (receive time stamp)
+    int attempts;           // times the command was sent
+} at_response;
+
+typedef void (*at_callback)(void *context, const at_response *response);
+// lines that do not answer the command in flight (unsolicited result codes, late answers)
+typedef void (*at_line_handler)(void *context, const char *line, int length);
+
+typedef struct {
+    const char *command;    // sent as is, CR/LF included; copied by at_submit
+    const char *prefix;     // answer that completes the command, e.g. "+VER:" (an ERROR in it
+                            // gives AT_ERROR); NULL for a plain OK / ERROR. Must stay valid.
+    uint32_t timeout_us;    // per attempt
+    int attempts;           // sends before giving up, 0 counts as 1
+    uint32_t delay_us;      // wait before the first send, for example while the module restarts
+    at_callback done;       // called from at_poll with the result, may submit further commands
+    void *context;
+} at_request;
+
+typedef struct {
+    at_request request;
+    char command[AT_COMMAND_MAX];
+} at_pending;
+
+TYPED_QUEUE(at_queue, at_pending, AT_QUEUE_SIZE)
+
+// One command is in flight at a time, the rest wait in the queue. Everything happens in
+// at_poll, which never waits: it takes the lines the receive interrupt has completed (the
+// port must be in line mode), matches them, handles timeouts and sends the next command.
+typedef struct {
+    int uart_nr;
+    at_queue_t queue;
+    at_pending current;
+    bool active;            // current is in flight (or waiting for its delay)
+    bool sent;
+    int attempts;
+    uint64_t sent_us;       // time of the last send
+    uint64_t due_us;        // first send after the delay, then timeout of the attempt
+    at_line_handler unsolicited;
+    void *context;
+    char line[AT_LINE_MAX];
+    uint32_t completed;
+    uint32_t errors;
+    uint32_t timeouts;
+    uint32_t unsolicited_lines;
+} at_engine;
+
+// unsolicited may be NULL
+void at_init(at_engine *at, int uart_nr, at_line_handler unsolicited, void *context);
+// queue a command, false if the queue is full or the command is longer than AT_COMMAND_MAX - 1
+bool at_submit(at_engine *at, const at_request *request);
+// call regularly with time_us_64() (the clock of the receive time stamps)
+void at_poll(at_engine *at, uint64_t now_us);
+// no command in flight or queued
+bool at_idle(at_engine *at);
+
+#endif //UART_IRQ_AT_ENGINE_H
@@ -0,0 +1,88 @@
+//
+// In-place parsing of AT answers.
+//
+#include "at_parse.h"
+
+bool at_literal(at_cursor *c, const char *text)
+{
+    while(*text) {
+        if(c->next == c->end || *c->next != *text) return false;
+        ++c->next;
+        ++text;
+    }
+    return true;
+}
+
+void at_spaces(at_cursor *c)
+{
+    while(c->next < c->end && *c->next == ' ') ++c->next;
+}
+
+bool at_uint(at_cursor *c, uint32_t max, uint32_t *value)
+{
+    uint64_t v = 0; // never more than max * 10 + 9
+    const char *start = c->next;
+    while(c->next < c->end && *c->next >= '0' && *c->next <= '9') {
+        v = v * 10 + (*c->next++ - '0');
+        if(v > max) return false;
+    }
+    if(c->next == start) return false;
+    *value = (uint32_t) v;
+    return true;
+}
+
+static int at_hex_digit(char ch)
+{
+    if(ch >= '0' && ch <= '9') return ch - '0';
+    ch |= 0x20; // lower case
+    if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+}
+
+bool at_hex_bytes(at_cursor *c, uint8_t *bytes, int count)
+{
+    for(int i = 0; i < count; ++i) {
+        if(i > 0 && c->next < c->end && *c->next == ':') ++c->next;
+        if(c->end - c->next < 2) return false;
+        int high = at_hex_digit(c->next[0]);
+        int low = at_hex_digit(c->next[1]);
+        if(high < 0 || low < 0) return false;
+        bytes[i] = (uint8_t) (high << 4 | low);
+        c->next += 2;
+    }
+    return true;
+}
+
+bool at_done(at_cursor *c)
+{
+    at_spaces(c);
+    return c->next == c->end;
+}
+
+bool at_parse_version(const char *line, int length, at_version *version)
+{
+    at_cursor c = at_cursor_of(line, length);
+    uint32_t major, minor, patch;
+    if(!at_literal(&c, "+VER:")) return false;
+    at_spaces(&c);
+    if(!at_uint(&c, 255, &major) || !at_literal(&c, ".") || !at_uint(&c, 255, &minor) ||
+       !at_literal(&c, ".") || !at_uint(&c, 255, &patch) || !at_done(&c)) return false;
+    version->major = (uint8_t) major;
+    version->minor = (uint8_t) minor;
+    version->patch = (uint8_t) patch;
+    return true;
+}
+
+bool at_parse_deveui(const char *line, int length, uint8_t eui[AT_EUI_SIZE])
+{
+    at_cursor c = at_cursor_of(line, length);
+    uint8_t bytes[AT_EUI_SIZE];
+    if(!at_literal(&c, "+ID:")) return false;
+    at_spaces(&c);
+    if(!at_literal(&c, "DevEui,")) return false;
+    at_spaces(&c);
+    // eui is left alone unless the whole field is valid
+    if(!at_hex_bytes(&c, bytes, AT_EUI_SIZE) || !at_done(&c)) return false;
+    for(int i = 0; i < AT_EUI_SIZE; ++i) eui[i] = bytes[i];
+    return true;
+}
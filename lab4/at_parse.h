@@ -0,0 +1,50 @@
+//
+// In-place parsing of AT answers: a cursor walks the line where it lies and fields are
+// converted straight to binary, without copying or intermediate strings.
+//
+
+#ifndef UART_IRQ_AT_PARSE_H
+#define UART_IRQ_AT_PARSE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AT_EUI_SIZE 8
+
+// next: first character not consumed yet, end: one past the last character of the line
+typedef struct {
+    const char *next;
+    const char *end;
+} at_cursor;
+
+typedef struct {
+    uint8_t major;
+    uint8_t minor;
+    uint8_t patch;
+} at_version;
+
+static inline at_cursor at_cursor_of(const char *line, int length)
+{
+    at_cursor c = { line, line + length };
+    return c;
+}
+
+// The field functions consume what they match and return true. On a mismatch they return
+// false and the cursor position is undefined.
+// text exactly
+bool at_literal(at_cursor *c, const char *text);
+// any number of spaces
+void at_spaces(at_cursor *c);
+// decimal number up to max
+bool at_uint(at_cursor *c, uint32_t max, uint32_t *value);
+// count bytes as pairs of hex digits (either case), optionally separated by ':'
+bool at_hex_bytes(at_cursor *c, uint8_t *bytes, int count);
+// nothing left but spaces
+bool at_done(at_cursor *c);
+
+// "+VER: 4.0.11"
+bool at_parse_version(const char *line, int length, at_version *version);
+// "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70"
+bool at_parse_deveui(const char *line, int length, uint8_t eui[AT_EUI_SIZE]);
+
+#endif //UART_IRQ_AT_PARSE_H
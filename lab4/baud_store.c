@@ -0,0 +1,72 @@
+//
+// Persist the UART speed negotiated with the LoRa module across boots.
+//
+#include <string.h>
+#include "baud_store.h"
+
+#if PICO_ON_DEVICE
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+#define BAUD_STORE_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define BAUD_STORE_MAGIC 0x42415544u    // "BAUD"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t baud;
+    uint32_t check;     // ~baud, an erased or half written sector does not pass
+} baud_record;
+
+int baud_store_load(void)
+{
+    const baud_record *r = (const baud_record *) (XIP_BASE + BAUD_STORE_OFFSET);
+    if(r->magic != BAUD_STORE_MAGIC || r->check != ~r->baud) return 0;
+    return (int) r->baud;
+}
+
+void baud_store_save(int baud)
+{
+    // flash wears out, only write on change
+    if(baud_store_load() == baud) return;
+
+    uint8_t page[FLASH_PAGE_SIZE];
+    baud_record r = { BAUD_STORE_MAGIC, (uint32_t) baud, ~(uint32_t) baud };
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &r, sizeof(r));
+
+    // nothing may run from flash while it is erased and programmed
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(BAUD_STORE_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(BAUD_STORE_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(interrupts);
+}
+#else
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *baud_store_file(void)
+{
+    const char *file = getenv("BAUD_STORE_FILE");
+    return file ? file : "lab4_baud.txt";
+}
+
+int baud_store_load(void)
+{
+    int baud = 0;
+    FILE *f = fopen(baud_store_file(), "r");
+    if(!f) return 0;
+    if(fscanf(f, "%d", &baud) != 1) baud = 0;
+    fclose(f);
+    return baud;
+}
+
+void baud_store_save(int baud)
+{
+    if(baud_store_load() == baud) return;
+    FILE *f = fopen(baud_store_file(), "w");
+    if(!f) return;
+    fprintf(f, "%d\n", baud);
+    fclose(f);
+}
+#endif
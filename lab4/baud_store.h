@@ -0,0 +1,18 @@
+//
+// Persist the UART speed negotiated with the LoRa module across boots.
+//
+
+#ifndef UART_IRQ_BAUD_STORE_H
+#define UART_IRQ_BAUD_STORE_H
+
+#include <stdint.h>
+
+// On the device the rate lives in the last sector of flash, on the host in the file named by
+// BAUD_STORE_FILE (default lab4_baud.txt in the working directory).
+// stored rate, 0 if none was saved
+int baud_store_load(void);
+// save the rate if it differs from the stored one (a flash erase + program on the device,
+// interrupts are off for a few tens of milliseconds; core1 must not run from flash)
+void baud_store_save(int baud);
+
+#endif //UART_IRQ_BAUD_STORE_H
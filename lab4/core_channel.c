@@ -0,0 +1,119 @@
+//
+// Inter-core message channel: one lock-free SPSC ring per direction plus a doorbell.
+//
+#include "core_channel.h"
+
+#if PICO_ON_DEVICE
+#include "pico/multicore.h"
+#else
+#include <time.h>
+#endif
+
+#define CC_HEADER 2
+
+void cc_init(core_channel *ch)
+{
+    for(int i = 0; i < 2; ++i) {
+        rb_init(&ch->ring[i], ch->storage[i], CC_RING_SIZE);
+        ch->pending[i] = -1;
+    }
+#if !PICO_ON_DEVICE
+    pthread_mutex_init(&ch->lock, NULL);
+    for(int i = 0; i < 2; ++i) {
+        pthread_cond_init(&ch->doorbell[i], NULL);
+        ch->rung[i] = false;
+    }
+#endif
+}
+
+bool cc_write(core_channel *ch, int core, const void *msg, int len)
+{
+    ring_buffer *rb = &ch->ring[!core];
+    uint8_t header[CC_HEADER] = { (uint8_t) len, (uint8_t) (len >> 8) };
+
+    // single producer: free space can only grow until the writes below are done
+    if(len < 0 || len > 0xffff || rb_capacity(rb) - rb_count(rb) < CC_HEADER + len) {
+        rb->dropped += CC_HEADER + (len > 0 ? len : 0);
+        return false;
+    }
+    rb_write(rb, header, CC_HEADER);
+    rb_write(rb, msg, len);
+    return true;
+}
+
+void cc_flush(core_channel *ch, int core)
+{
+#if PICO_ON_DEVICE
+    // a full fifo already holds doorbells the other core has not seen yet
+    if(multicore_fifo_wready()) multicore_fifo_push_blocking(0);
+#else
+    pthread_mutex_lock(&ch->lock);
+    ch->rung[!core] = true;
+    pthread_cond_signal(&ch->doorbell[!core]);
+    pthread_mutex_unlock(&ch->lock);
+#endif
+}
+
+bool cc_send(core_channel *ch, int core, const void *msg, int len)
+{
+    if(!cc_write(ch, core, msg, len)) return false;
+    cc_flush(ch, core);
+    return true;
+}
+
+int cc_receive(core_channel *ch, int core, void *buf, int max)
+{
+    ring_buffer *rb = &ch->ring[core];
+
+    // the writer publishes header and payload separately, so either may still be missing
+    if(ch->pending[core] < 0) {
+        uint8_t header[CC_HEADER];
+        if(rb_count(rb) < CC_HEADER) return -1;
+        rb_read(rb, header, CC_HEADER);
+        ch->pending[core] = header[0] | header[1] << 8;
+    }
+    int len = ch->pending[core];
+    if(rb_count(rb) < len) return -1;
+
+    int copied = rb_read(rb, buf, len < max ? len : max);
+    // skip whatever did not fit in buf
+    while(copied < len) {
+        const uint8_t *span;
+        int n = rb_peek_read(rb, &span);
+        if(n > len - copied) n = len - copied;
+        rb_consume(rb, n);
+        copied += n;
+    }
+    ch->pending[core] = -1;
+    return len < max ? len : max;
+}
+
+bool cc_wait(core_channel *ch, int core, uint32_t timeout_us)
+{
+#if PICO_ON_DEVICE
+    uint32_t doorbell;
+    if(!rb_empty(&ch->ring[core])) return true;
+    bool rung = multicore_fifo_pop_timeout_us(timeout_us, &doorbell);
+    // one wakeup covers every doorbell rung so far
+    while(multicore_fifo_rvalid()) multicore_fifo_pop_blocking();
+    return rung;
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_us / 1000000;
+    deadline.tv_nsec += (long) (timeout_us % 1000000) * 1000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&ch->lock);
+    while(!ch->rung[core] && rb_empty(&ch->ring[core])) {
+        if(pthread_cond_timedwait(&ch->doorbell[core], &ch->lock, &deadline)) break;
+    }
+    bool rung = ch->rung[core] || !rb_empty(&ch->ring[core]);
+    ch->rung[core] = false;
+    pthread_mutex_unlock(&ch->lock);
+    return rung;
+#endif
+}
@@ -0,0 +1,52 @@
+//
+// Inter-core message channel: one lock-free SPSC ring per direction plus a doorbell.
+//
+
+#ifndef UART_IRQ_CORE_CHANNEL_H
+#define UART_IRQ_CORE_CHANNEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring_buffer.h"
+
+#if !PICO_ON_DEVICE
+#include <pthread.h>
+#endif
+
+// bytes per direction including a 2 byte length header per message, must be a power of two
+#ifndef CC_RING_SIZE
+#define CC_RING_SIZE 1024
+#endif
+
+// Each core only ever writes to the ring towards the other core and only reads its own,
+// so both rings are single-producer / single-consumer and need no locking.
+// The doorbell is the SIO FIFO on the RP2040 (the value pushed is ignored), and a
+// condition variable on the host where the two "cores" are threads.
+// The SIO FIFO is shared with multicore_launch_core1 and multicore_lockout, so start core1
+// before using the channel and do not combine it with the lockout API.
+typedef struct {
+    ring_buffer ring[2];            // ring[n] carries messages to core n
+    int pending[2];                 // payload length of a message whose header core n has read, -1 if none
+    uint8_t storage[2][CC_RING_SIZE];
+#if !PICO_ON_DEVICE
+    pthread_mutex_t lock;
+    pthread_cond_t doorbell[2];
+    bool rung[2];
+#endif
+} core_channel;
+
+// core is always the number of the calling core (get_core_num() on the device)
+void cc_init(core_channel *ch);
+// queue a message for the other core without ringing the doorbell, false if it does not fit
+bool cc_write(core_channel *ch, int core, const void *msg, int len);
+// ring the other core's doorbell, once per batch of cc_write calls
+void cc_flush(core_channel *ch, int core);
+// cc_write + cc_flush
+bool cc_send(core_channel *ch, int core, const void *msg, int len);
+// copy the next complete message to buf and return its length, -1 if there is none.
+// Messages longer than max are truncated to max bytes.
+int cc_receive(core_channel *ch, int core, void *buf, int max);
+// sleep until the doorbell rings or timeout_us passes, true if messages may be waiting
+bool cc_wait(core_channel *ch, int core, uint32_t timeout_us);
+
+#endif //UART_IRQ_CORE_CHANNEL_H
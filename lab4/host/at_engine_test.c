@@ -0,0 +1,230 @@
+// Host test and benchmark for the AT command engine.
+// A host backend port stands in for the LoRa module: its sink collects the commands the
+// engine transmits and answers them through uart_host_receive, or stays silent to force
+// retries and timeouts. Time is passed to at_poll explicitly, so timeouts and send delays
+// are checked without waiting. The benchmark runs transactions back to back through the
+// engine to give its cost per command.
+//   at_engine_test [commands] > results.csv
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uart.h"
+#include "uart_host.h"
+#include "at_engine.h"
+#include "bench.h"
+
+#define MODULE 0
+
+static char command[AT_COMMAND_MAX];
+static int command_len;
+static int commands;        // received by the module
+static int silent;          // commands to ignore before answering again
+
+static void module(void *context, const uint8_t *data, int len)
+{
+    for(int i = 0; i < len; ++i) {
+        if(command_len < (int) sizeof(command) - 1) command[command_len++] = (char) data[i];
+        if(data[i] != '\n') continue;
+        command[command_len] = '\0';
+        command_len = 0;
+        ++commands;
+        if(silent > 0) {
+            --silent;
+            continue;
+        }
+        const char *answer = "+AT: ERROR(-1)\r\n";
+        if(strcmp(command, "AT\r\n") == 0) answer = "+AT: OK\r\n";
+        else if(strcmp(command, "AT+VER\r\n") == 0) answer = "+VER: 4.0.11\r\n";
+        else if(strcmp(command, "AT+PLAIN\r\n") == 0) answer = "OK\r\n";
+        else if(strcmp(command, "AT+BAD\r\n") == 0) answer = "ERROR\r\n";
+        uart_host_receive(MODULE, (const uint8_t *) answer, (int) strlen(answer));
+    }
+}
+
+UART_HOST_PORT(lora, 256, 256, module, NULL);
+
+uart_port *const uart_ports[] = { &lora };
+const int uart_port_count = sizeof(uart_ports) / sizeof(uart_ports[0]);
+
+static at_engine at;
+
+typedef struct {
+    int calls;
+    at_response response;
+    char line[AT_LINE_MAX];
+} result_log;
+
+static void record(void *context, const at_response *response)
+{
+    result_log *log = context;
+    ++log->calls;
+    log->response = *response;
+    snprintf(log->line, sizeof(log->line), "%s", response->line);
+}
+
+static int unsolicited_calls;
+
+static void unsolicited(void *context, const char *line, int length)
+{
+    ++unsolicited_calls;
+}
+
+static void reset(void)
+{
+    uart_setup(MODULE, 0, 0, 9600);
+    uart_set_line_mode(MODULE, true);
+    at_init(&at, MODULE, unsolicited, NULL);
+    commands = 0;
+    silent = 0;
+    command_len = 0;
+    unsolicited_calls = 0;
+}
+
+static void report(const char *test, long count, double elapsed, long errors)
+{
+    printf("%s,%ld,%.6f,%.3f,%ld\n", test, count, elapsed, elapsed * 1e6 / count, errors);
+}
+
+static at_request request(const char *cmd, const char *prefix, int attempts, result_log *log)
+{
+    at_request r = { cmd, prefix, 500000, attempts, 0, record, log };
+    return r;
+}
+
+// answers matched by prefix, plain OK and ERROR lines, in queue order
+static long check_matching(void)
+{
+    result_log logs[4] = { 0 };
+    long errors = 0;
+
+    reset();
+    at_request r[4] = {
+        request("AT\r\n", "+AT:", 1, &logs[0]),
+        request("AT+VER\r\n", "+VER:", 1, &logs[1]),
+        request("AT+PLAIN\r\n", NULL, 1, &logs[2]),
+        request("AT+BAD\r\n", NULL, 1, &logs[3]),
+    };
+    for(int i = 0; i < 4; ++i) {
+        if(!at_submit(&at, &r[i])) ++errors;
+    }
+    // each poll completes one command and sends the next
+    for(int i = 0; i < 5; ++i) at_poll(&at, 1000);
+    if(!at_idle(&at) || commands != 4 || unsolicited_calls != 0) ++errors;
+    if(logs[0].response.result != AT_OK || strcmp(logs[0].line, "+AT: OK") != 0) ++errors;
+    if(logs[1].response.result != AT_OK || strcmp(logs[1].line, "+VER: 4.0.11") != 0) ++errors;
+    if(logs[2].response.result != AT_OK || logs[3].response.result != AT_ERROR) ++errors;
+    for(int i = 0; i < 4; ++i) {
+        if(logs[i].calls != 1 || logs[i].response.attempts != 1) ++errors;
+    }
+    // an error answer with the command's prefix
+    at_request bad = request("AT+XYZ\r\n", "+AT:", 3, &logs[0]);
+    at_submit(&at, &bad);
+    at_poll(&at, 2000);
+    at_poll(&at, 2000);
+    if(logs[0].response.result != AT_ERROR || logs[0].response.attempts != 1 || at.errors != 2) ++errors;
+    report("matching", 5, 0, errors);
+    return errors;
+}
+
+// unanswered attempts are sent again after the timeout, then the command times out
+static long check_timeouts(void)
+{
+    result_log log = { 0 };
+    long errors = 0;
+
+    reset();
+    silent = 2;
+    at_request r = request("AT\r\n", "+AT:", 3, &log);
+    at_submit(&at, &r);
+    at_poll(&at, 0);
+    at_poll(&at, 499999);
+    if(commands != 1 || log.calls != 0) ++errors;
+    at_poll(&at, 500000);
+    if(commands != 2) ++errors;
+    // the third attempt is answered
+    at_poll(&at, 1000000);
+    at_poll(&at, 1000000);
+    if(commands != 3 || log.calls != 1 || log.response.result != AT_OK || log.response.attempts != 3) ++errors;
+
+    silent = 5;
+    r = request("AT\r\n", "+AT:", 2, &log);
+    at_submit(&at, &r);
+    at_poll(&at, 2000000);
+    at_poll(&at, 2500000);
+    at_poll(&at, 3000000);
+    if(commands != 5 || log.calls != 2 || log.response.result != AT_TIMEOUT || at.timeouts != 1) ++errors;
+    if(!at_idle(&at)) ++errors;
+    report("timeouts", 2, 0, errors);
+    return errors;
+}
+
+// a delayed command waits, lines nobody asked for go to the unsolicited handler
+static long check_delay_unsolicited(void)
+{
+    result_log log = { 0 };
+    long errors = 0;
+
+    reset();
+    uart_host_receive(MODULE, (const uint8_t *) "+EVT: WAKE\r\n\r\n", 14);
+    at_poll(&at, 0);
+    if(unsolicited_calls != 1) ++errors;
+    at_request r = request("AT\r\n", "+AT:", 1, &log);
+    r.delay_us = 300000;
+    at_submit(&at, &r);
+    at_poll(&at, 1000);
+    at_poll(&at, 300999);
+    if(commands != 0) ++errors;
+    at_poll(&at, 301000);
+    at_poll(&at, 301000);
+    if(commands != 1 || log.calls != 1 || log.response.result != AT_OK) ++errors;
+    // queue limit and command length
+    for(int i = 0; i < AT_QUEUE_SIZE; ++i) {
+        if(!at_submit(&at, &r)) ++errors;
+    }
+    if(at_submit(&at, &r)) ++errors;
+    r.command = "AT+THIS_COMMAND_IS_FAR_TOO_LONG_TO_QUEUE\r\n";
+    at_init(&at, MODULE, NULL, NULL);
+    if(at_submit(&at, &r)) ++errors;
+    report("delay_unsolicited", 1, 0, errors);
+    return errors;
+}
+
+static void again(void *context, const at_response *response)
+{
+    long *remaining = context;
+    if(response->result != AT_OK) return;
+    if(--*remaining > 0) {
+        at_request r = { "AT+VER\r\n", "+VER:", 500000, 1, 0, again, remaining };
+        at_submit(&at, &r);
+    }
+}
+
+// each answer queues the next command from its callback
+static long bench_transactions(long count)
+{
+    long remaining = count;
+    long errors = 0;
+
+    reset();
+    at_request r = { "AT+VER\r\n", "+VER:", 500000, 1, 0, again, &remaining };
+    at_submit(&at, &r);
+    double start = now_s();
+    while(remaining > 0 && !at_idle(&at)) at_poll(&at, 0);
+    double elapsed = now_s() - start;
+    if(remaining != 0 || commands != count || at.completed != count) ++errors;
+    report("transactions", count, elapsed, errors);
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    long count = argc > 1 ? atol(argv[1]) : 1000000;
+    long errors = 0;
+
+    printf("test,commands,seconds,us_per_command,errors\n");
+    errors += check_matching();
+    errors += check_timeouts();
+    errors += check_delay_unsolicited();
+    errors += bench_transactions(count);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+// Host test and benchmark for the in-place AT answer parser.
+// Checks the cursor fields and the +VER / +ID answers, including malformed and truncated
+// lines, which must be rejected without reading past the given length. The benchmark
+// parses a DevEui answer to bytes, and for comparison does the copy-and-lowercase
+// formatting main.c used to do.
+//   at_parse_test [lines] > results.csv
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "at_parse.h"
+#include "bench.h"
+
+static const uint8_t expected_eui[AT_EUI_SIZE] = { 0x2c, 0xf7, 0xf1, 0x20, 0x32, 0x30, 0xa5, 0x70 };
+static const char deveui_line[] = "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70";
+
+static void report(const char *test, long lines, double elapsed, long errors)
+{
+    printf("%s,%ld,%.6f,%.2f,%ld\n", test, lines, elapsed, elapsed * 1e9 / lines, errors);
+}
+
+static bool deveui(const char *line, uint8_t *eui)
+{
+    return at_parse_deveui(line, (int) strlen(line), eui);
+}
+
+static bool version(const char *line, at_version *v)
+{
+    return at_parse_version(line, (int) strlen(line), v);
+}
+
+static long check_fields(void)
+{
+    long errors = 0;
+    uint32_t value;
+    uint8_t bytes[2];
+
+    at_cursor c = at_cursor_of("+UART: BR, 115200", 17);
+    if(!at_literal(&c, "+UART:") || at_literal(&c, "BR")) ++errors;
+    c = at_cursor_of("+UART: BR, 115200", 17);
+    at_literal(&c, "+UART:");
+    at_spaces(&c);
+    if(!at_literal(&c, "BR,")) ++errors;
+    at_spaces(&c);
+    if(!at_uint(&c, 1000000, &value) || value != 115200 || !at_done(&c)) ++errors;
+    // limits
+    c = at_cursor_of("256", 3);
+    if(at_uint(&c, 255, &value)) ++errors;
+    c = at_cursor_of("4294967295", 10);
+    if(!at_uint(&c, UINT32_MAX, &value) || value != UINT32_MAX) ++errors;
+    c = at_cursor_of("4294967296", 10);
+    if(at_uint(&c, UINT32_MAX, &value)) ++errors;
+    c = at_cursor_of("x", 1);
+    if(at_uint(&c, 255, &value)) ++errors;
+    // the length bounds the cursor, not the terminator
+    c = at_cursor_of("12345", 2);
+    if(!at_uint(&c, 1000, &value) || value != 12 || !at_done(&c)) ++errors;
+    c = at_cursor_of("ab:CD", 5);
+    if(!at_hex_bytes(&c, bytes, 2) || bytes[0] != 0xab || bytes[1] != 0xcd) ++errors;
+    c = at_cursor_of("abCD", 4);
+    if(!at_hex_bytes(&c, bytes, 2) || bytes[0] != 0xab || bytes[1] != 0xcd) ++errors;
+    c = at_cursor_of("ab:C", 4);
+    if(at_hex_bytes(&c, bytes, 2)) ++errors;
+    c = at_cursor_of("ag", 2);
+    if(at_hex_bytes(&c, bytes, 1)) ++errors;
+    return errors;
+}
+
+static long check_answers(void)
+{
+    long errors = 0;
+    uint8_t eui[AT_EUI_SIZE];
+    at_version v;
+
+    if(!deveui(deveui_line, eui) || memcmp(eui, expected_eui, AT_EUI_SIZE) != 0) ++errors;
+    if(!deveui("+ID: DevEui, 2cf7f1203230a570", eui) || memcmp(eui, expected_eui, AT_EUI_SIZE) != 0) ++errors;
+    // a rejected answer leaves eui alone
+    memset(eui, 0, sizeof(eui));
+    if(deveui("+ID: DevEui, 2C:F7:F1:20:32:30:A5", eui)) ++errors;
+    if(deveui("+ID: DevEui, 2C:F7:F1:20:32:30:A5:70:11", eui)) ++errors;
+    if(deveui("+ID: AppEui, 2C:F7:F1:20:32:30:A5:70", eui)) ++errors;
+    if(deveui("+ID: DevEui, 2C:F7:F1:20:32:30:A5:7G", eui)) ++errors;
+    if(eui[0] != 0) ++errors;
+    // stops at the length even though the line goes on
+    if(deveui("", eui) || at_parse_deveui(deveui_line, (int) sizeof(deveui_line) - 3, eui)) ++errors;
+
+    if(!version("+VER: 4.0.11", &v) || v.major != 4 || v.minor != 0 || v.patch != 11) ++errors;
+    if(!version("+VER:1.2.3 ", &v) || v.major != 1 || v.minor != 2 || v.patch != 3) ++errors;
+    if(version("+VER: 4.0", &v) || version("+VER: 4.0.11a", &v) || version("+VER: 4.0.256", &v)) ++errors;
+    if(version("+AT: OK", &v) || at_parse_version("+VER: 4.0.11", 10, &v)) ++errors;
+    return errors;
+}
+
+static long bench_parse(long lines)
+{
+    uint8_t eui[AT_EUI_SIZE];
+    long errors = 0;
+    int len = (int) strlen(deveui_line);
+
+    double start = now_s();
+    for(long i = 0; i < lines; ++i) {
+        if(!at_parse_deveui(deveui_line, len, eui)) ++errors;
+    }
+    double elapsed = now_s() - start;
+    if(memcmp(eui, expected_eui, AT_EUI_SIZE) != 0) ++errors;
+    report("at_parse_deveui", lines, elapsed, errors);
+    return errors;
+}
+
+// the old format_deveui: copy to a buffer without the colons, lower case
+static long bench_copy(long lines)
+{
+    char copy[60];
+    long errors = 0;
+    int len = (int) strlen(deveui_line);
+    unsigned sum = 0; // keeps the copies from being optimised away
+
+    double start = now_s();
+    for(long i = 0; i < lines; ++i) {
+        int j = 0;
+        for(int k = 0; k < len; ++k) {
+            if(deveui_line[k] != ':') copy[j++] = (char) tolower((unsigned char) deveui_line[k]);
+        }
+        copy[j] = '\0';
+        sum += (unsigned char) copy[i & 15];
+    }
+    double elapsed = now_s() - start;
+    if(sum == 0 || strcmp(copy, "+id deveui, 2cf7f1203230a570") != 0) ++errors;
+    report("copy_lowercase", lines, elapsed, errors);
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    long lines = argc > 1 ? atol(argv[1]) : 10000000;
+    long errors = 0;
+
+    printf("test,lines,seconds,ns_per_line,errors\n");
+    errors += check_fields();
+    errors += check_answers();
+    errors += bench_parse(lines);
+    errors += bench_copy(lines);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
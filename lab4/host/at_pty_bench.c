@@ -0,0 +1,279 @@
+// Runs the lab4 AT state machine (main.c, unchanged) natively against a scripted LoRa module
+// on a pseudo terminal. main.c talks to the pty slave through the uart_posix backend, whose
+// thread stands in for the UART interrupts; the peer thread on the pty master answers the
+// commands the way the LoRa-E5 does, including the AT+UART=BR / AT+RESET speed change.
+// With wire timing on, the peer takes 10 bit times per byte at the rate both ends agreed on
+// and ignores commands sent at any other rate, so the negotiated speed shows in the results.
+// The button is pressed once per cycle (AT, AT+VER, AT+ID=DEVEUI); the first cycle also
+// negotiates the speed. main.c's console output is discarded unless AT_PTY_VERBOSE is set.
+// module_start_baud is the rate the module kept from an earlier run; no rate is stored on
+// the host side, so with anything but the default the probe has to find the module.
+// A cycle that fails or a wrong stored speed fails the run.
+//   at_pty_bench [cycles] [module_max_baud] [wire_timing] [module_start_baud] > results.csv
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "baud_store.h"
+#include "uart_posix.h"
+#include "uart_stdio.h"
+#include "uart_host.h"
+#include "bench.h"
+
+#define BUTTON_GPIO 7
+#define MODULE_BAUD 9600        // module default and main.c BAUD_RATE
+#define FAST_BAUD 115200        // main.c FAST_BAUD_RATE
+
+int lab4_main(void);
+
+static void console_sink(void *context, const uint8_t *data, int size)
+{
+}
+
+// UART0 is unused by main.c, UART1 is the LoRa module
+UART_HOST_PORT(u0, 64, 64, console_sink, NULL);
+UART_POSIX_PORT(lora, NULL, 256, 256);
+
+uart_port *const uart_ports[] = { &u0, &lora };
+const int uart_port_count = sizeof(uart_ports) / sizeof(uart_ports[0]);
+
+// pico/stdlib stand-ins, the button blocks until the bench presses it
+static pthread_mutex_t button_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t button_cond = PTHREAD_COND_INITIALIZER;
+static int presses;
+static int polls;
+
+bool stdio_init_all(void)
+{
+    return true;
+}
+
+void sleep_ms(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+// same clock as the receive time stamps
+uint64_t time_us_64(void)
+{
+    return uart_time_us();
+}
+
+// the console stays on the host stdout
+void uart_stdio_init(int uart_nr, uart_stdio_policy policy) { }
+
+uint32_t uart_stdio_dropped(void)
+{
+    return 0;
+}
+
+void gpio_init(uint gpio) { }
+void gpio_set_dir(uint gpio, bool out) { }
+void gpio_pull_up(uint gpio) { }
+
+bool gpio_get(uint gpio)
+{
+    if(gpio != BUTTON_GPIO) return true;
+    pthread_mutex_lock(&button_lock);
+    ++polls;
+    pthread_cond_broadcast(&button_cond);
+    while(presses < polls) pthread_cond_wait(&button_cond, &button_lock);
+    pthread_mutex_unlock(&button_lock);
+    return false;   // pressed, the button pulls the pin low
+}
+
+// scripted module
+static const struct {
+    const char *command;
+    const char *response;
+} script[] = {
+    { "AT\r\n", "+AT: OK\r\n" },
+    { "AT+VER\r\n", "+VER: 4.0.11\r\n" },
+    { "AT+ID=DEVEUI\r\n", "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70\r\n" },
+};
+
+static int master;
+static int module_max_baud;
+static bool wire_timing;
+static int module_baud = MODULE_BAUD;
+static int pending_baud = MODULE_BAUD;
+static long bytes_in, bytes_out, deveui, garbled, unknown;
+
+static void wire_time(size_t bytes)
+{
+    if(wire_timing) usleep((useconds_t) (bytes * 10 * 1000000ull / module_baud));
+}
+
+static void respond(const char *response)
+{
+    size_t len = strlen(response);
+    wire_time(len);
+    if(write(master, response, len) == (ssize_t) len) bytes_out += len;
+}
+
+static void peer_command(const char *line, size_t len)
+{
+    char reply[40];
+
+    wire_time(len);
+    bytes_in += len;
+    // at different speeds the module only sees framing errors
+    if(lora_state.speed != module_baud) {
+        ++garbled;
+        return;
+    }
+    for(size_t i = 0; i < sizeof(script) / sizeof(script[0]); ++i) {
+        if(strcmp(line, script[i].command) == 0) {
+            if(i == 2) ++deveui;
+            respond(script[i].response);
+            return;
+        }
+    }
+    int baud;
+    if(sscanf(line, "AT+UART=BR, %d", &baud) == 1) {
+        if(baud > module_max_baud) {
+            respond("+UART: ERROR(-1)\r\n");
+            return;
+        }
+        pending_baud = baud;
+        snprintf(reply, sizeof(reply), "+UART: BR, %d\r\n", baud);
+        respond(reply);
+    } else if(strcmp(line, "AT+RESET\r\n") == 0) {
+        respond("+RESET: OK\r\n");
+        module_baud = pending_baud;
+    } else {
+        ++unknown;
+        respond("+AT: ERROR(-1)\r\n");
+    }
+}
+
+static void *peer_thread(void *arg)
+{
+    char line[128];
+    size_t len = 0;
+
+    for(;;) {
+        char buf[64];
+        ssize_t n = read(master, buf, sizeof(buf));
+        // EIO until the slave is opened
+        if(n <= 0) {
+            usleep(1000);
+            continue;
+        }
+        for(ssize_t i = 0; i < n; ++i) {
+            if(len < sizeof(line) - 1) line[len++] = buf[i];
+            if(buf[i] == '\n') {
+                line[len] = '\0';
+                peer_command(line, len);
+                len = 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void *app_thread(void *arg)
+{
+    lab4_main();
+    return NULL;
+}
+
+// press the button and wait until main.c is back polling it
+static double cycle(void)
+{
+    double start = now_s();
+    pthread_mutex_lock(&button_lock);
+    int target = ++presses + 1;
+    pthread_cond_broadcast(&button_cond);
+    while(polls < target) pthread_cond_wait(&button_cond, &button_lock);
+    pthread_mutex_unlock(&button_lock);
+    return now_s() - start;
+}
+
+static void report(FILE *out, const char *test, int cycles, double total, double min, double max,
+                   long bytes, long errors)
+{
+    fprintf(out, "%s,%d,%d,%d,%.6f,%.3f,%.3f,%.3f,%.1f,%.0f,%ld\n", test, module_max_baud,
+            wire_timing, cycles, total, total * 1e3 / cycles, min * 1e3, max * 1e3,
+            cycles * 3 / total, bytes / total, errors);
+}
+
+int main(int argc, char **argv)
+{
+    int cycles = argc > 1 ? atoi(argv[1]) : 20;
+    module_max_baud = argc > 2 ? atoi(argv[2]) : FAST_BAUD;
+    wire_timing = argc > 3 ? atoi(argv[3]) != 0 : true;
+    module_baud = pending_baud = argc > 4 ? atoi(argv[4]) : MODULE_BAUD;
+    bool lost_rate = module_baud != MODULE_BAUD;
+    if(cycles < 1) cycles = 1;
+
+    // results on the real stdout, main.c prints to the discarded one
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if(!getenv("AT_PTY_VERBOSE")) freopen("/dev/null", "w", stdout);
+
+    char store[] = "/tmp/at_pty_baud_XXXXXX";
+    int fd = mkstemp(store);
+    if(fd < 0) return EXIT_FAILURE;
+    close(fd);
+    unlink(store);  // no rate stored: main.c starts at BAUD_RATE
+    setenv("BAUD_STORE_FILE", store, 1);
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("pty");
+        return EXIT_FAILURE;
+    }
+    lora_state.path = ptsname(master);
+
+    pthread_t peer, app;
+    pthread_create(&peer, NULL, peer_thread, NULL);
+    pthread_create(&app, NULL, app_thread, NULL);
+
+    // wait for the boot to reach the button
+    pthread_mutex_lock(&button_lock);
+    while(polls < 1) pthread_cond_wait(&button_cond, &button_lock);
+    pthread_mutex_unlock(&button_lock);
+
+    long before = deveui;
+    double first = cycle();
+    long errors_first = deveui != before + 1;
+    // probing at the wrong rate is only expected while the module's rate is unknown
+    if(!lost_rate) errors_first += garbled;
+    garbled = 0;
+    long errors = 0;
+    long bytes_first = bytes_in + bytes_out;
+
+    double total = 0, min = 1e9, max = 0;
+    for(int i = 0; i < cycles; ++i) {
+        before = deveui;
+        double t = cycle();
+        errors += deveui != before + 1;
+        total += t;
+        if(t < min) min = t;
+        if(t > max) max = t;
+    }
+
+    int expected = module_max_baud >= FAST_BAUD ? FAST_BAUD : MODULE_BAUD;
+    int stored = baud_store_load();
+    errors += stored != expected;
+    errors += garbled + unknown;
+
+    fprintf(out, "test,module_max_baud,wire_timing,cycles,seconds,cycle_ms_avg,cycle_ms_min,cycle_ms_max,commands_per_s,bytes_per_s,errors\n");
+    report(out, "negotiate", 1, first, first, first, bytes_first, errors_first);
+    report(out, "steady", cycles, total, min, max, bytes_in + bytes_out - bytes_first, errors);
+    fflush(out);
+    fflush(stdout);
+    errors += errors_first;
+    if(errors) {
+        fprintf(stderr, "speed %d stored %d, module ignored %ld commands, unknown %ld\n",
+                lora_state.speed, stored, garbled, unknown);
+    }
+    unlink(store);
+    // main.c never returns, leave it waiting for the button
+    _exit(errors ? EXIT_FAILURE : EXIT_SUCCESS);
+}
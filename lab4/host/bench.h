@@ -0,0 +1,39 @@
+// Helpers shared by the host tests and benchmarks in this directory.
+// Each program prints its results on stdout, as CSV with a header line where it produces a
+// table, so runs before and after a change can be diffed or plotted, and exits non-zero if
+// any check fails so ctest picks it up.
+#ifndef LAB4_HOST_BENCH_H
+#define LAB4_HOST_BENCH_H
+
+#include <stdint.h>
+#include <time.h>
+
+static inline double clock_s(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// wall clock seconds for timing a run
+static inline double now_s(void)
+{
+    return clock_s(CLOCK_MONOTONIC);
+}
+
+// Pseudo random numbers that are the same on every run, so a failure can be repeated.
+// The state is per program; seed_random picks the sequence.
+static uint32_t bench_lcg = 1;
+
+static inline void seed_random(uint32_t seed)
+{
+    bench_lcg = seed;
+}
+
+static inline uint32_t next_random(void)
+{
+    bench_lcg = bench_lcg * 1103515245u + 12345u;
+    return bench_lcg >> 16;
+}
+
+#endif //LAB4_HOST_BENCH_H
@@ -0,0 +1,134 @@
+// Host benchmark for the inter-core channel.
+// Two threads stand in for core0 and core1. Throughput is measured with core0 streaming
+// sequence numbered messages in batches, latency by ping-ponging one message.
+// Every message must arrive intact and in order.
+//   cc_bench [messages_per_test] > results.csv
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "core_channel.h"
+#include "bench.h"
+
+#define MAX_MESSAGE 64
+
+static const int message_sizes[] = { 4, 16, 64 };
+static const int batch_sizes[] = { 1, 8, 32 };
+
+static core_channel ch;
+static long messages;
+static int message_size;
+
+static void fill(uint8_t *msg, long seq, int size)
+{
+    memset(msg, (uint8_t) seq, size);
+    memcpy(msg, &seq, size < sizeof(seq) ? size : sizeof(seq));
+}
+
+// core1: receive and verify the stream
+static void *sink(void *arg)
+{
+    uint8_t msg[MAX_MESSAGE];
+    uint8_t expected[MAX_MESSAGE];
+    long errors = 0;
+
+    for(long seq = 0; seq < messages; ) {
+        int len = cc_receive(&ch, 1, msg, sizeof(msg));
+        if(len < 0) {
+            cc_wait(&ch, 1, 1000);
+            continue;
+        }
+        fill(expected, seq, message_size);
+        if(len != message_size || memcmp(msg, expected, len) != 0) ++errors;
+        ++seq;
+    }
+    return (void *) errors;
+}
+
+// core1: send every message straight back
+static void *echo(void *arg)
+{
+    uint8_t msg[MAX_MESSAGE];
+
+    for(long i = 0; i < messages; ) {
+        int len = cc_receive(&ch, 1, msg, sizeof(msg));
+        if(len < 0) {
+            cc_wait(&ch, 1, 1000);
+            continue;
+        }
+        while(!cc_send(&ch, 1, msg, len)) sched_yield();
+        ++i;
+    }
+    return NULL;
+}
+
+static long bench_throughput(int size, int batch)
+{
+    pthread_t t;
+    void *errors;
+    uint8_t msg[MAX_MESSAGE];
+
+    message_size = size;
+    cc_init(&ch);
+    pthread_create(&t, NULL, sink, NULL);
+    double start = now_s();
+    for(long seq = 0; seq < messages; ++seq) {
+        fill(msg, seq, size);
+        while(!cc_write(&ch, 0, msg, size)) {
+            cc_flush(&ch, 0);
+            sched_yield();
+        }
+        if((seq + 1) % batch == 0) cc_flush(&ch, 0);
+    }
+    cc_flush(&ch, 0);
+    pthread_join(t, &errors);
+    double elapsed = now_s() - start;
+
+    printf("throughput,%d,%d,%ld,%.6f,%.0f,%.2f,%ld\n", size, batch, messages, elapsed,
+           messages / elapsed, elapsed * 1e9 / messages, (long) errors);
+    return (long) errors;
+}
+
+static long bench_latency(int size)
+{
+    pthread_t t;
+    uint8_t msg[MAX_MESSAGE];
+    uint8_t reply[MAX_MESSAGE];
+    long errors = 0;
+
+    cc_init(&ch);
+    pthread_create(&t, NULL, echo, NULL);
+    double start = now_s();
+    for(long seq = 0; seq < messages; ++seq) {
+        fill(msg, seq, size);
+        cc_send(&ch, 0, msg, size);
+        int len;
+        while((len = cc_receive(&ch, 0, reply, sizeof(reply))) < 0) cc_wait(&ch, 0, 1000);
+        if(len != size || memcmp(msg, reply, len) != 0) ++errors;
+    }
+    double elapsed = now_s() - start;
+    pthread_join(t, NULL);
+
+    printf("latency,%d,1,%ld,%.6f,%.0f,%.2f,%ld\n", size, messages, elapsed,
+           messages / elapsed, elapsed * 1e9 / messages, errors);
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    long errors = 0;
+    long count = argc > 1 ? atol(argv[1]) : 1000000;
+
+    printf("test,message_size,batch,messages,seconds,messages_per_s,ns_per_message,errors\n");
+    for(int i = 0; i < sizeof(message_sizes) / sizeof(message_sizes[0]); ++i) {
+        messages = count;
+        for(int j = 0; j < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++j) {
+            errors += bench_throughput(message_sizes[i], batch_sizes[j]);
+        }
+        // round trips are far slower, keep the run time comparable
+        messages = count / 100 > 0 ? count / 100 : 1;
+        errors += bench_latency(message_sizes[i]);
+    }
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,243 @@
+// Host test for the UART line discipline.
+// Recorded LoRa module traffic is published to the rx ring in random sized chunks, with
+// ld_scan after each one as the receive interrupt does, and read back with ld_read:
+//  - interleaved single threaded, every line must arrive intact and in order
+//  - in overwrite mode with a stalling reader, every line returned must be the tail of a
+//    real line and nothing may be returned twice
+//  - with a producer thread, the reader sleeping in rx_wait_for until a line is complete
+// It also reports the cost of fetching a line against searching for it with rb_read_until.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "line_disc.h"
+#include "rx_wait.h"
+#include "bench.h"
+
+#define RB_SIZE 256
+#define LINE 80
+
+static const char *recorded[] = {
+    "+AT: OK\r\n",
+    "+VER: 4.0.11\r\n",
+    "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70\r\n",
+    "\r\n",
+    "+ID: DevAddr, 42:00:2F:A5\r\n",
+    "+MODE: LWOTAA\r\n",
+    "+JOIN: Start\r\n",
+    "+JOIN: NetID 000000 DevAddr 42:00:2F:A5\r\n",
+};
+#define RECORDED (int) (sizeof(recorded) / sizeof(recorded[0]))
+
+static uint8_t storage[RB_SIZE];
+static ring_buffer rx;
+static line_disc ld;
+static rx_wait w;
+static long lines;
+
+static void reset(bool overwrite)
+{
+    rb_init(&rx, storage, RB_SIZE);
+    rb_set_overwrite(&rx, overwrite);
+    ld_init(&ld, &rx);
+}
+
+// the byte stream: recorded lines back to back
+static uint8_t stream_byte(long pos, long *line)
+{
+    static long cached_line, cached_start;
+    static int cached_len = -1;
+    if(cached_len < 0 || pos < cached_start) {
+        cached_line = 0;
+        cached_start = 0;
+        cached_len = (int) strlen(recorded[0]);
+    }
+    while(pos >= cached_start + cached_len) {
+        cached_start += cached_len;
+        ++cached_line;
+        cached_len = (int) strlen(recorded[cached_line % RECORDED]);
+    }
+    if(line) *line = cached_line;
+    return (uint8_t) recorded[cached_line % RECORDED][pos - cached_start];
+}
+
+// publish up to n bytes of the stream starting at *pos, like an RX interrupt
+static void publish(long *pos, int n, long end)
+{
+    uint8_t chunk[64];
+    if(n > (int) sizeof(chunk)) n = sizeof(chunk);
+    if(n > end - *pos) n = (int) (end - *pos);
+    if(!rx.overwrite && n > rb_capacity(&rx) - rb_count(&rx)) n = rb_capacity(&rx) - rb_count(&rx);
+    for(int i = 0; i < n; ++i) chunk[i] = stream_byte(*pos + i, NULL);
+    rb_write(&rx, chunk, n);
+    *pos += n;
+    // the stream position stands in for the arrival time
+    ld_scan(&ld, (uint64_t) *pos);
+}
+
+static long stream_length(long count)
+{
+    long length = 0;
+    for(long i = 0; i < count; ++i) length += (long) strlen(recorded[i % RECORDED]);
+    return length;
+}
+
+static long test_in_order(void)
+{
+    uint8_t line[LINE];
+    uint64_t stamp;
+    long errors = 0;
+    long pos = 0, end = stream_length(lines), next = 0, line_end = 0;
+
+    reset(false);
+    while(next < lines) {
+        if(pos < end) publish(&pos, 1 + next_random() % 24, end);
+        int reads = next_random() % 3;
+        for(int i = 0; i < reads; ++i) {
+            int len = ld_read(&ld, line, LINE, &stamp);
+            if(len < 0) break;
+            if(strcmp((char *) line, recorded[next % RECORDED]) != 0) ++errors;
+            // stamped by the publish that contained the LF
+            line_end += len;
+            if(stamp < (uint64_t) line_end || stamp >= (uint64_t) line_end + 24) ++errors;
+            ++next;
+        }
+    }
+    if(ld_read(&ld, line, LINE, NULL) != -1 || ld.dropped != 0 || !rb_empty(&rx)) ++errors;
+
+    printf("in order %ld lines errors %ld\n", lines, errors);
+    return errors;
+}
+
+// a line read after an overwrite must be the end of one of the recorded lines
+static bool line_tail(const uint8_t *line, int len)
+{
+    for(int i = 0; i < RECORDED; ++i) {
+        int full = (int) strlen(recorded[i]);
+        if(len <= full && memcmp(line, recorded[i] + full - len, len) == 0) return len == 0 || line[len - 1] == '\n';
+    }
+    return false;
+}
+
+static long test_overwrite(void)
+{
+    uint8_t line[LINE];
+    long errors = 0, got = 0;
+    long pos = 0, end = stream_length(lines);
+    int stall = 0;
+
+    reset(true);
+    while(pos < end || ld_count(&ld) > 0) {
+        if(pos < end) publish(&pos, 1 + next_random() % 32, end);
+        // every so often the reader stalls for long enough to be lapped
+        if(stall > 0) {
+            --stall;
+            continue;
+        }
+        if(next_random() % 32 == 0) stall = 10 + next_random() % 20;
+        int len;
+        while((len = ld_read(&ld, line, LINE, NULL)) >= 0) {
+            if(!line_tail(line, len)) ++errors;
+            ++got;
+        }
+    }
+    // lines are never returned twice
+    if(got > lines) ++errors;
+
+    printf("overwrite %ld lines, %ld read, %u not queued, %u bytes overwritten, errors %ld\n",
+           lines, got, ld.dropped, rx.overwritten, errors);
+    return errors;
+}
+
+static void *producer(void *arg)
+{
+    long pos = 0, end = stream_length(lines);
+    while(pos < end) {
+        publish(&pos, 1 + next_random() % 16, end);
+        rx_wait_signal(&w);
+        usleep(50);
+    }
+    return NULL;
+}
+
+static bool line_ready(void *arg)
+{
+    return ld_count(arg) > 0;
+}
+
+static long test_threaded(void)
+{
+    pthread_t t;
+    uint8_t line[LINE];
+    long errors = 0;
+
+    reset(false);
+    rx_wait_init(&w);
+    pthread_create(&t, NULL, producer, NULL);
+    for(long i = 0; i < lines; ++i) {
+        if(!rx_wait_for(&w, line_ready, &ld, 1000000) || ld_read(&ld, line, LINE, NULL) < 0 ||
+           strcmp((char *) line, recorded[i % RECORDED]) != 0) {
+            ++errors;
+        }
+    }
+    pthread_join(t, NULL);
+
+    printf("threaded %ld lines errors %ld\n", lines, errors);
+    return errors;
+}
+
+// fetch cost against the byte at a time reassembly send_command used to do, and against
+// searching for the line end with rb_read_until; the ring is refilled with whole lines
+static void bench(void)
+{
+    uint8_t line[LINE];
+    double elapsed[3] = { 0 };
+    long read[3] = { 0 };
+
+    for(int method = 0; method < 3; ++method) {
+        long pos = 0, end = stream_length(lines);
+        int len = 0;    // byte at a time: partial line carried over between refills
+        reset(false);
+        while(pos < end) {
+            // stop short of a full ring so only whole lines are published
+            while(pos < end && rb_count(&rx) < rb_capacity(&rx) - LINE) publish(&pos, 64, end);
+            double start = now_s();
+            if(method == 0) {
+                while(ld_read(&ld, line, LINE, NULL) >= 0) ++read[0];
+            }
+            else if(method == 1) {
+                uint8_t c;
+                while(rb_read(&rx, &c, 1) == 1) {
+                    if(len < LINE - 1) line[len++] = c;
+                    if(c == '\n') {
+                        line[len] = '\0';
+                        len = 0;
+                        ++read[1];
+                    }
+                }
+            }
+            else {
+                while(rb_read_until(&rx, line, LINE - 1, '\n') > 0) ++read[2];
+            }
+            elapsed[method] += now_s() - start;
+            // the byte stream only ends on whole lines at the very end
+            if(method != 0) ld_init(&ld, &rx);
+        }
+    }
+    printf("fetch %ld lines: ld_read %.1f ns/line, byte at a time %.1f ns/line, rb_read_until %.1f ns/line\n",
+           read[0], elapsed[0] * 1e9 / read[0], elapsed[1] * 1e9 / read[1], elapsed[2] * 1e9 / read[2]);
+}
+
+int main(int argc, char **argv)
+{
+    long errors = 0;
+    lines = argc > 1 ? atol(argv[1]) : 100000;
+    seed_random(4242);
+
+    errors += test_in_order();
+    errors += test_overwrite();
+    errors += test_threaded();
+    bench();
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+// Host stand-in for the parts of pico/stdlib.h that lab4/main.c uses, so the application
+// can be built natively. Only the host build puts this directory on the include path; the
+// functions are defined by the program that runs main.c (see at_pty_bench.c).
+#ifndef LAB4_HOST_PICO_STDLIB_H
+#define LAB4_HOST_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+#define GPIO_IN false
+#define GPIO_OUT true
+
+bool stdio_init_all(void);
+void sleep_ms(uint32_t ms);
+uint64_t time_us_64(void);
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_pull_up(uint gpio);
+bool gpio_get(uint gpio);
+
+#endif //LAB4_HOST_PICO_STDLIB_H
@@ -0,0 +1,158 @@
+// Ring buffer microbenchmark for the host.
+// Measures single byte put/get (also through the inline fast path of a ring with a compile
+// time capacity), bulk transfers and cross-thread SPSC throughput and round trip latency
+// at several capacities:
+//   rb_bench [bytes_per_test] > before.csv
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring_buffer.h"
+#include "bench.h"
+
+#define MAX_CAPACITY 4096
+#define BULK_CHUNK 32
+#define FIXED_CAPACITY 256
+
+static const int capacities[] = { 16, 64, 256, 1024, 4096 };
+
+static uint8_t storage[MAX_CAPACITY];
+static uint8_t storage2[MAX_CAPACITY];
+static ring_buffer rb;
+static ring_buffer rb2;
+static long ops;
+RB_DEFINE(fixed_rb, FIXED_CAPACITY);
+
+static void backoff(void)
+{
+    sched_yield();
+}
+
+static void report(const char *test, int capacity, long count, double elapsed)
+{
+    printf("%s,%d,%ld,%.6f,%.0f,%.2f\n", test, capacity, count, elapsed, count / elapsed, elapsed * 1e9 / count);
+}
+
+// single thread: fill half the buffer and drain it again, one byte at a time
+static void bench_put_get(int capacity)
+{
+    volatile uint8_t sink = 0;
+    int half = capacity / 2;
+
+    rb_init(&rb, storage, capacity);
+    double start = now_s();
+    for(long i = 0; i < ops; i += half) {
+        for(int k = 0; k < half; ++k) rb_put(&rb, (uint8_t) k);
+        for(int k = 0; k < half; ++k) sink = rb_get(&rb);
+    }
+    report("put_get", capacity, ops, now_s() - start);
+    (void) sink;
+}
+
+// the same through fixed_rb_put/fixed_rb_get, where the wrap mask is a constant
+static void bench_put_get_fixed(void)
+{
+    volatile uint8_t sink = 0;
+    int half = FIXED_CAPACITY / 2;
+
+    double start = now_s();
+    for(long i = 0; i < ops; i += half) {
+        for(int k = 0; k < half; ++k) fixed_rb_put((uint8_t) k);
+        for(int k = 0; k < half; ++k) sink = fixed_rb_get();
+    }
+    report("put_get_fixed", FIXED_CAPACITY, ops, now_s() - start);
+    (void) sink;
+}
+
+// single thread: the same traffic in BULK_CHUNK sized rb_write/rb_read calls
+static void bench_bulk(int capacity)
+{
+    uint8_t chunk[BULK_CHUNK] = { 0 };
+    int n = capacity / 2 < BULK_CHUNK ? capacity / 2 : BULK_CHUNK;
+
+    rb_init(&rb, storage, capacity);
+    double start = now_s();
+    for(long i = 0; i < ops; i += n) {
+        rb_write(&rb, chunk, n);
+        rb_read(&rb, chunk, n);
+    }
+    report("bulk", capacity, ops, now_s() - start);
+}
+
+static void *spsc_producer(void *arg)
+{
+    for(long i = 0; i < ops; ++i) {
+        while(!rb_put(&rb, (uint8_t) i)) backoff();
+    }
+    return NULL;
+}
+
+static void *spsc_consumer(void *arg)
+{
+    for(long i = 0; i < ops; ++i) {
+        while(rb_empty(&rb)) backoff();
+        rb_get(&rb);
+    }
+    return NULL;
+}
+
+// two threads: producer and consumer streaming one byte at a time
+static void bench_spsc(int capacity)
+{
+    pthread_t p, c;
+
+    rb_init(&rb, storage, capacity);
+    double start = now_s();
+    pthread_create(&c, NULL, spsc_consumer, NULL);
+    pthread_create(&p, NULL, spsc_producer, NULL);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+    report("spsc", capacity, ops, now_s() - start);
+}
+
+static long round_trips;
+
+static void *echo(void *arg)
+{
+    for(long i = 0; i < round_trips; ++i) {
+        while(rb_empty(&rb)) backoff();
+        uint8_t c = rb_get(&rb);
+        while(!rb_put(&rb2, c)) backoff();
+    }
+    return NULL;
+}
+
+// two threads: ping-pong a single byte through a pair of buffers, reports time per round trip
+static void bench_latency(int capacity)
+{
+    pthread_t t;
+
+    round_trips = ops / 100 > 0 ? ops / 100 : 1;
+    rb_init(&rb, storage, capacity);
+    rb_init(&rb2, storage2, capacity);
+    pthread_create(&t, NULL, echo, NULL);
+    double start = now_s();
+    for(long i = 0; i < round_trips; ++i) {
+        rb_put(&rb, (uint8_t) i);
+        while(rb_empty(&rb2)) backoff();
+        rb_get(&rb2);
+    }
+    double elapsed = now_s() - start;
+    pthread_join(t, NULL);
+    report("latency", capacity, round_trips, elapsed);
+}
+
+int main(int argc, char **argv)
+{
+    ops = argc > 1 ? atol(argv[1]) : 10000000;
+
+    printf("test,capacity,ops,seconds,ops_per_s,ns_per_op\n");
+    for(int i = 0; i < sizeof(capacities) / sizeof(capacities[0]); ++i) {
+        bench_put_get(capacities[i]);
+        if(capacities[i] == FIXED_CAPACITY) bench_put_get_fixed();
+        bench_bulk(capacities[i]);
+        bench_spsc(capacities[i]);
+        bench_latency(capacities[i]);
+    }
+    return EXIT_SUCCESS;
+}
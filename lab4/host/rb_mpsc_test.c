@@ -0,0 +1,85 @@
+// Host stress test for the multi-producer ring buffer.
+// Several producer threads write 4 byte records (producer id + 24 bit sequence number)
+// while one consumer reads the byte stream back with the normal ring_buffer read API.
+// The test fails if any record is lost, torn or out of order within its producer.
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring_buffer_mp.h"
+#include "bench.h"
+
+#define RB_SIZE 256
+#define PRODUCERS 3
+#define RECORD 4
+
+static long records_per_producer;
+static mp_ring_buffer mp;
+static uint8_t storage[RB_SIZE];
+
+static void *producer(void *arg)
+{
+    uint8_t id = (uint8_t) (intptr_t) arg;
+    for(long i = 0; i < records_per_producer; ++i) {
+        uint8_t record[RECORD] = { id, (uint8_t) i, (uint8_t) (i >> 8), (uint8_t) (i >> 16) };
+        while(!rb_mp_write(&mp, record, RECORD)) sched_yield();
+    }
+    return NULL;
+}
+
+static long consume(void)
+{
+    long errors = 0;
+    long next[PRODUCERS] = { 0 };
+    long total = records_per_producer * PRODUCERS;
+    uint8_t record[RECORD];
+    int have = 0;
+
+    for(long received = 0; received < total; ) {
+        int n = rb_read(&mp.rb, record + have, RECORD - have);
+        if(n == 0) {
+            sched_yield();
+            continue;
+        }
+        have += n;
+        if(have < RECORD) continue;
+        have = 0;
+        ++received;
+
+        uint8_t id = record[0];
+        long seq = record[1] | record[2] << 8 | (long) record[3] << 16;
+        if(id >= PRODUCERS) {
+            ++errors;
+            continue;
+        }
+        if(seq != (next[id] & 0xffffff)) ++errors;
+        next[id] = seq + 1;
+    }
+    for(int i = 0; i < PRODUCERS; ++i) {
+        if(next[i] != (records_per_producer & 0xffffff)) ++errors;
+    }
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t threads[PRODUCERS];
+
+    records_per_producer = argc > 1 ? atol(argv[1]) : 1000000;
+    rb_mp_init(&mp, storage, RB_SIZE);
+
+    double start = now_s();
+    for(int i = 0; i < PRODUCERS; ++i) {
+        pthread_create(&threads[i], NULL, producer, (void *) (intptr_t) i);
+    }
+    long errors = consume();
+    for(int i = 0; i < PRODUCERS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_s() - start;
+
+    long records = records_per_producer * PRODUCERS;
+    printf("mpsc %d producers %ld records %8.3f s %10.2f Mrecords/s errors %ld\n",
+           PRODUCERS, records, elapsed, records / elapsed / 1e6, errors);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,279 @@
+// Host stress test for the SPSC ring buffer.
+// One thread plays the UART ISR (producer) and another the main loop (consumer).
+// Every byte carries a sequence number so loss, duplication and reordering are detected.
+// The byte, inline constant capacity, bulk, zero-copy and overwrite paths each get a run.
+// The same run is repeated with the original modulo based ring buffer for comparison.
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring_buffer.h"
+#include "bench.h"
+
+#define RB_SIZE 256
+
+// Original implementation (int indices, modulo wrap, no memory ordering).
+// volatile is needed here, otherwise the compiler is free to hoist the index loads
+// out of the polling loops and the threads never see each other.
+typedef struct {
+    volatile int head;
+    volatile int tail;
+    int size;
+    uint8_t *buffer;
+} legacy_ring_buffer;
+
+static bool legacy_empty(legacy_ring_buffer *rb)
+{
+    return rb->head == rb->tail;
+}
+
+static bool legacy_put(legacy_ring_buffer *rb, uint8_t data)
+{
+    int nh = (rb->head + 1) % rb->size;
+    if(nh == rb->tail) return false;
+
+    rb->buffer[rb->head] = data;
+    rb->head = nh;
+    return true;
+}
+
+static uint8_t legacy_get(legacy_ring_buffer *rb)
+{
+    uint8_t value = rb->buffer[rb->tail];
+    if(rb->head != rb->tail) {
+        rb->tail = (rb->tail + 1) % rb->size;
+    }
+    return value;
+}
+
+static long iterations;
+static ring_buffer rb;
+static legacy_ring_buffer legacy;
+static uint8_t rb_storage[RB_SIZE];
+static uint8_t legacy_storage[RB_SIZE];
+
+// give the other thread a chance to run, the test may run on a single cpu
+static void backoff(void)
+{
+    sched_yield();
+}
+
+static void *rb_producer(void *arg)
+{
+    for(long i = 0; i < iterations; ++i) {
+        while(!rb_put(&rb, (uint8_t) i)) backoff();
+    }
+    return NULL;
+}
+
+static void *rb_consumer(void *arg)
+{
+    long errors = 0;
+    for(long i = 0; i < iterations; ++i) {
+        while(rb_empty(&rb)) backoff();
+        if(rb_get(&rb) != (uint8_t) i) ++errors;
+    }
+    return (void *) errors;
+}
+
+// the inline fast paths with the capacity as a constant
+static void *rb_fixed_producer(void *arg)
+{
+    for(long i = 0; i < iterations; ++i) {
+        while(!rb_put_fixed(&rb, (uint8_t) i, RB_SIZE)) backoff();
+    }
+    return NULL;
+}
+
+static void *rb_fixed_consumer(void *arg)
+{
+    long errors = 0;
+    for(long i = 0; i < iterations; ++i) {
+        while(rb_empty(&rb)) backoff();
+        if(rb_get_fixed(&rb, RB_SIZE) != (uint8_t) i) ++errors;
+    }
+    return (void *) errors;
+}
+
+// bulk transfers in varying chunk sizes so both the single and the wrapping memcpy paths run
+static void *rb_bulk_producer(void *arg)
+{
+    uint8_t chunk[61];
+    long i = 0;
+    while(i < iterations) {
+        int n = 1 + (int) (i % sizeof(chunk));
+        if(n > iterations - i) n = (int) (iterations - i);
+        for(int k = 0; k < n; ++k) chunk[k] = (uint8_t) (i + k);
+        int written = 0;
+        while(written < n) {
+            int w = rb_write(&rb, chunk + written, n - written);
+            if(w == 0) backoff();
+            written += w;
+        }
+        i += n;
+    }
+    return NULL;
+}
+
+static void *rb_bulk_consumer(void *arg)
+{
+    uint8_t chunk[47];
+    long errors = 0;
+    long i = 0;
+    while(i < iterations) {
+        int n = rb_read(&rb, chunk, sizeof(chunk));
+        if(n == 0) backoff();
+        for(int k = 0; k < n; ++k, ++i) {
+            if(chunk[k] != (uint8_t) i) ++errors;
+        }
+    }
+    return (void *) errors;
+}
+
+// zero-copy transfers, both sides work directly in the ring buffer storage
+static void *rb_span_producer(void *arg)
+{
+    long i = 0;
+    while(i < iterations) {
+        uint8_t *span;
+        int n = rb_reserve_write(&rb, &span);
+        if(n > iterations - i) n = (int) (iterations - i);
+        if(n == 0) backoff();
+        for(int k = 0; k < n; ++k) span[k] = (uint8_t) (i + k);
+        rb_commit_write(&rb, n);
+        i += n;
+    }
+    return NULL;
+}
+
+static void *rb_span_consumer(void *arg)
+{
+    long errors = 0;
+    long i = 0;
+    while(i < iterations) {
+        const uint8_t *span;
+        int n = rb_peek_read(&rb, &span);
+        if(n == 0) backoff();
+        for(int k = 0; k < n; ++k, ++i) {
+            if(span[k] != (uint8_t) i) ++errors;
+        }
+        rb_consume(&rb, n);
+    }
+    return (void *) errors;
+}
+
+// overwrite-oldest: the producer never waits, the consumer must only ever see the byte
+// that was written at the position it reads and nothing may go missing uncounted
+static void *rb_overwrite_producer(void *arg)
+{
+    for(long i = 0; i < iterations; ++i) {
+        rb_put(&rb, (uint8_t) i);
+        if((i & 1023) == 0) backoff();
+    }
+    return NULL;
+}
+
+static void *rb_overwrite_consumer(void *arg)
+{
+    long errors = 0;
+    long received = 0;
+    while(atomic_load(&rb.tail) < (uint32_t) iterations) {
+        if(rb_empty(&rb)) {
+            backoff();
+            continue;
+        }
+        uint8_t value = rb_get(&rb);
+        uint32_t position = atomic_load(&rb.tail) - 1;
+        if(value != (uint8_t) position) ++errors;
+        ++received;
+    }
+    if(received + rb.overwritten != iterations) ++errors;
+    printf("overwrite: received %ld overwritten %u\n", received, rb.overwritten);
+    return (void *) errors;
+}
+
+static void *legacy_producer(void *arg)
+{
+    for(long i = 0; i < iterations; ++i) {
+        while(!legacy_put(&legacy, (uint8_t) i)) backoff();
+    }
+    return NULL;
+}
+
+static void *legacy_consumer(void *arg)
+{
+    long errors = 0;
+    for(long i = 0; i < iterations; ++i) {
+        while(legacy_empty(&legacy)) backoff();
+        if(legacy_get(&legacy) != (uint8_t) i) ++errors;
+    }
+    return (void *) errors;
+}
+
+static int watermark_events[2];
+
+static void count_watermark(rb_event event, void *context)
+{
+    ++watermark_events[event];
+}
+
+// single thread: watermark callbacks fire once per crossing, not once per byte
+static long check_watermarks(void)
+{
+    uint8_t data[RB_SIZE] = { 0 };
+
+    rb_init(&rb, rb_storage, RB_SIZE);
+    rb_set_watermarks(&rb, 16, 200, count_watermark, NULL);
+    for(int round = 0; round < 3; ++round) {
+        for(int i = 0; i < 210; ++i) rb_put(&rb, 0);     // crosses 200 once
+        rb_read(&rb, data, 100);                         // 110 left
+        rb_write(&rb, data, 100);                        // crosses 200 again
+        while(rb_count(&rb) > 0) rb_read(&rb, data, 7);  // crosses 16 once
+    }
+    long errors = watermark_events[RB_EVENT_HIGH] != 6 || watermark_events[RB_EVENT_LOW] != 3;
+    printf("watermarks high %d low %d errors %ld\n",
+           watermark_events[RB_EVENT_HIGH], watermark_events[RB_EVENT_LOW], errors);
+    return errors;
+}
+
+static long run(const char *name, void *(*producer)(void *), void *(*consumer)(void *))
+{
+    pthread_t p, c;
+    void *errors;
+
+    double start = now_s();
+    pthread_create(&c, NULL, consumer, NULL);
+    pthread_create(&p, NULL, producer, NULL);
+    pthread_join(p, NULL);
+    pthread_join(c, &errors);
+    double elapsed = now_s() - start;
+
+    printf("%-10s %10ld bytes %8.3f s %10.2f Mops/s errors %ld\n",
+           name, iterations, elapsed, iterations / elapsed / 1e6, (long) errors);
+    return (long) errors;
+}
+
+int main(int argc, char **argv)
+{
+    iterations = argc > 1 ? atol(argv[1]) : 10000000;
+
+    rb_init(&rb, rb_storage, RB_SIZE);
+    legacy = (legacy_ring_buffer) { .head = 0, .tail = 0, .size = RB_SIZE, .buffer = legacy_storage };
+
+    long errors = check_watermarks();
+    rb_init(&rb, rb_storage, RB_SIZE);
+    errors += run("spsc", rb_producer, rb_consumer);
+    rb_init(&rb, rb_storage, RB_SIZE);
+    errors += run("fixed", rb_fixed_producer, rb_fixed_consumer);
+    rb_init(&rb, rb_storage, RB_SIZE);
+    errors += run("bulk", rb_bulk_producer, rb_bulk_consumer);
+    rb_init(&rb, rb_storage, RB_SIZE);
+    errors += run("span", rb_span_producer, rb_span_consumer);
+    rb_init(&rb, rb_storage, RB_SIZE);
+    rb_set_overwrite(&rb, true);
+    errors += run("overwrite", rb_overwrite_producer, rb_overwrite_consumer);
+    run("legacy", legacy_producer, legacy_consumer);
+
+    // only the new implementation is required to be correct
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+// Host test for rx_wait, the sleeping receive path behind uart_read_until.
+// A producer thread stands in for the UART interrupt: it publishes recorded LoRa module
+// responses to the rx ring in small chunks with gaps between them and signals after each.
+// The consumer reads them back line by line with rx_wait_read_until and must get every line
+// intact while using only a fraction of the CPU time a polling loop would.
+// Timeouts, partial lines and truncation are checked single threaded.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "rx_wait.h"
+#include "bench.h"
+
+#define RB_SIZE 256
+#define LINE 80
+
+static const char *recorded[] = {
+    "+AT: OK\r\n",
+    "+VER: 4.0.11\r\n",
+    "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70\r\n",
+    "+MODE: LWOTAA\r\n",
+    "+JOIN: Start\r\n",
+    "+JOIN: Network joined\r\n",
+};
+#define RECORDED (int) (sizeof(recorded) / sizeof(recorded[0]))
+
+static uint8_t storage[RB_SIZE];
+static ring_buffer rx;
+static rx_wait w;
+static long lines;
+
+// the "interrupt": chunks of up to 7 bytes every 100 us, like a fifo drained at high baud
+static void *producer(void *arg)
+{
+    for(long i = 0; i < lines; ++i) {
+        const char *line = recorded[i % RECORDED];
+        int len = (int) strlen(line);
+        for(int sent = 0; sent < len; ) {
+            int n = len - sent < 7 ? len - sent : 7;
+            while(rb_capacity(&rx) - rb_count(&rx) < n) usleep(100);
+            rb_write(&rx, (const uint8_t *) line + sent, n);
+            rx_wait_signal(&w);
+            sent += n;
+            usleep(100);
+        }
+    }
+    return NULL;
+}
+
+static long test_lines(void)
+{
+    pthread_t t;
+    char line[LINE];
+    long errors = 0;
+
+    rb_init(&rx, storage, RB_SIZE);
+    rx_wait_init(&w);
+    double wall = now_s();
+    double cpu = clock_s(CLOCK_THREAD_CPUTIME_ID);
+    pthread_create(&t, NULL, producer, NULL);
+    for(long i = 0; i < lines; ++i) {
+        int len = rx_wait_read_until(&w, &rx, (uint8_t *) line, LINE, '\n', 1000000);
+        if(len != (int) strlen(recorded[i % RECORDED]) || strcmp(line, recorded[i % RECORDED]) != 0) ++errors;
+    }
+    cpu = clock_s(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    wall = now_s() - wall;
+    pthread_join(t, NULL);
+
+    printf("lines %ld in %.3f s, consumer cpu %.3f s (%.1f%%) errors %ld\n",
+           lines, wall, cpu, 100 * cpu / wall, errors);
+    // a polling reader would use all of it
+    if(cpu > wall / 2) {
+        printf("consumer did not sleep\n");
+        ++errors;
+    }
+    return errors;
+}
+
+static long test_timeouts(void)
+{
+    char line[LINE];
+    long errors = 0;
+
+    rb_init(&rx, storage, RB_SIZE);
+    rx_wait_init(&w);
+
+    // nothing arrives: waits the whole timeout and stores nothing
+    double start = now_s();
+    if(rx_wait_readable(&w, &rx, 20000)) ++errors;
+    if(rx_wait_read_until(&w, &rx, (uint8_t *) line, LINE, '\n', 20000) != 0 || line[0] != '\0') ++errors;
+    if(now_s() - start < 0.040) ++errors;
+
+    // partial line: returned at the timeout without the delimiter
+    rb_write(&rx, (const uint8_t *) "+AT: O", 6);
+    if(!rx_wait_readable(&w, &rx, 20000)) ++errors;
+    if(rx_wait_read_until(&w, &rx, (uint8_t *) line, LINE, '\n', 20000) != 6 || strcmp(line, "+AT: O") != 0) ++errors;
+
+    // two lines buffered: only the first is consumed
+    rb_write(&rx, (const uint8_t *) "OK\r\nERROR\r\n", 11);
+    if(rx_wait_read_until(&w, &rx, (uint8_t *) line, LINE, '\n', 20000) != 4 || strcmp(line, "OK\r\n") != 0) ++errors;
+    if(rb_count(&rx) != 7) ++errors;
+
+    // does not fit: max - 1 bytes and a terminator, the rest stays in the ring
+    if(rx_wait_read_until(&w, &rx, (uint8_t *) line, 4, '\n', 20000) != 3 || strcmp(line, "ERR") != 0) ++errors;
+    if(rb_count(&rx) != 4) ++errors;
+
+    // overwrite mode as on the UART: after the ring is lapped the first line may have lost its
+    // start, the ones after it are intact
+    rb_init(&rx, storage, RB_SIZE);
+    rb_set_overwrite(&rx, true);
+    for(int i = 0; i < RB_SIZE / 4 + 3; ++i) rb_write(&rx, (const uint8_t *) "OK\r\n", 4);
+    int len = rx_wait_read_until(&w, &rx, (uint8_t *) line, LINE, '\n', 20000);
+    if(len < 1 || len > 4 || line[len - 1] != '\n' || rx.overwritten < 12) ++errors;
+    if(rx_wait_read_until(&w, &rx, (uint8_t *) line, LINE, '\n', 20000) != 4 || strcmp(line, "OK\r\n") != 0) ++errors;
+
+    printf("timeouts errors %ld\n", errors);
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    long errors = 0;
+    lines = argc > 1 ? atol(argv[1]) : 1000;
+
+    errors += test_timeouts();
+    errors += test_lines();
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+// Host test and benchmark for the binary telemetry channel.
+// Frames are sent with tm_send through a host backend port whose sink feeds a tm_decoder, the
+// way the host side would read them from a serial adapter. Checks the CRC against its check
+// value, COBS round trips of random data, a stream of mixed messages with and without
+// corrupted bytes (every frame delivered must be intact) and the accounting of frames dropped
+// on a full tx ring. The benchmark sends the same sensor messages as frames and as printf
+// style text, giving the cost per message (including the sink feeding the decoder) and the
+// bytes each puts on the wire.
+//   telemetry_test [messages_per_test] > results.csv
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uart.h"
+#include "uart_host.h"
+#include "telemetry.h"
+#include "bench.h"
+
+typedef struct {
+    tm_decoder decoder;
+    uint32_t corrupt_every;     // flip a bit in every nth byte, 0 for none
+    uint32_t bytes;
+} wire;
+
+static wire wires[2];
+
+static void sink(void *context, const uint8_t *data, int len)
+{
+    wire *w = context;
+    uint8_t copy[TM_MAX_FRAME * 2];
+
+    for(int i = 0; i < len; ) {
+        int n = len - i < (int) sizeof(copy) ? len - i : (int) sizeof(copy);
+        memcpy(copy, data + i, n);
+        if(w->corrupt_every) {
+            for(int k = 0; k < n; ++k) {
+                if((w->bytes + k) % w->corrupt_every == 0) copy[k] ^= (uint8_t) (1 << (rand() % 8));
+            }
+        }
+        tm_decode(&w->decoder, copy, n);
+        w->bytes += n;
+        i += n;
+    }
+}
+
+// port 0 has room for any frame, port 1's tx ring is too small for a sensor frame
+UART_HOST_PORT(t0, 64, 256, sink, &wires[0]);
+UART_HOST_PORT(t1, 64, 16, sink, &wires[1]);
+
+uart_port *const uart_ports[] = { &t0, &t1 };
+const int uart_port_count = sizeof(uart_ports) / sizeof(uart_ports[0]);
+
+static long messages;
+static long received;
+static long bad;
+
+static void report(const char *test, double elapsed, double bytes, long errors)
+{
+    printf("%s,%ld,%.6f,%.1f,%.1f,%ld\n", test, messages, elapsed, elapsed * 1e9 / messages,
+           bytes / messages, errors);
+}
+
+// message i of the test stream, the index travels in time_us
+static int make_message(long i, uint8_t *id, uint8_t *payload)
+{
+    switch(i % 3) {
+        case 0: {
+            tm_sensor m = { (uint32_t) i, (int32_t) (i * 7 - 1000), (uint32_t) (i % 4) };
+            *id = TM_SENSOR;
+            memcpy(payload, &m, sizeof(m));
+            return sizeof(m);
+        }
+        case 1: {
+            // zero bytes in the payload exercise COBS
+            tm_motor m = { (uint32_t) i, (int32_t) (i % 4096), 0, 1 };
+            *id = TM_MOTOR;
+            memcpy(payload, &m, sizeof(m));
+            return sizeof(m);
+        }
+        default: {
+            uint32_t index = (uint32_t) i;
+            int len = 4 + snprintf((char *) payload + 4, TM_MAX_PAYLOAD - 4, "step %ld done", i);
+            memcpy(payload, &index, sizeof(index));
+            *id = TM_LOG;
+            return len;
+        }
+    }
+}
+
+static void check_message(void *context, uint8_t id, uint8_t seq, const uint8_t *payload, int len)
+{
+    uint8_t expected_id;
+    uint8_t expected[TM_MAX_PAYLOAD];
+    uint32_t index;
+
+    ++received;
+    if(len < 4) {
+        ++bad;
+        return;
+    }
+    memcpy(&index, payload, sizeof(index));
+    int expected_len = make_message(index, &expected_id, expected);
+    if(id != expected_id || len != expected_len || memcmp(payload, expected, len) != 0 || seq != (uint8_t) index) ++bad;
+}
+
+static long check_crc(void)
+{
+    // CRC-16/CCITT-FALSE check value
+    return tm_crc16((const uint8_t *) "123456789", 9) != 0x29B1;
+}
+
+static long check_cobs(void)
+{
+    static uint8_t src[600], enc[700], dec[700];
+    long errors = 0;
+
+    srand(1);
+    for(int round = 0; round < 2000; ++round) {
+        int len = rand() % (int) sizeof(src);
+        int zeros = rand() % 4;     // none, few, some, many
+        for(int i = 0; i < len; ++i) {
+            src[i] = (uint8_t) (zeros && rand() % (1 << (8 - 2 * zeros)) == 0 ? 0 : 1 + rand() % 255);
+        }
+        int n = tm_cobs_encode(src, len, enc);
+        if(n > len + len / 254 + 1 || memchr(enc, 0, n)) ++errors;
+        if(tm_cobs_decode(enc, n, dec) != len || memcmp(src, dec, len) != 0) ++errors;
+        // in place
+        if(tm_cobs_decode(enc, n, enc) != len || memcmp(src, enc, len) != 0) ++errors;
+    }
+    return errors;
+}
+
+static long check_stream(uint32_t corrupt_every)
+{
+    tm_channel tm;
+    uint8_t id, payload[TM_MAX_PAYLOAD];
+    long errors = 0;
+
+    uart_setup(0, 0, 0, 115200);
+    tm_init(&tm, 0);
+    tm_decoder_init(&wires[0].decoder, check_message, NULL);
+    wires[0].corrupt_every = corrupt_every;
+    wires[0].bytes = 0;
+    received = bad = 0;
+    srand(2);
+
+    double start = now_s();
+    for(long i = 0; i < messages; ++i) {
+        int len = make_message(i, &id, payload);
+        if(!tm_send(&tm, id, payload, len)) ++errors;
+    }
+    double elapsed = now_s() - start;
+
+    tm_decoder *d = &wires[0].decoder;
+    errors += bad;
+    if(corrupt_every == 0) {
+        if(received != messages || d->crc_errors || d->framing_errors || d->lost) ++errors;
+    } else {
+        // a damaged frame is rejected, never delivered
+        if(received == messages || d->crc_errors + d->framing_errors == 0) ++errors;
+    }
+    report(corrupt_every ? "stream_corrupted" : "stream", elapsed, wires[0].bytes, errors);
+    return errors;
+}
+
+static long check_drop(void)
+{
+    tm_channel tm;
+    tm_sensor m = { 0 };
+    long errors = 0;
+
+    uart_setup(1, 0, 0, 115200);
+    tm_init(&tm, 1);
+    tm_decoder_init(&wires[1].decoder, NULL, NULL);
+    tm_log(&tm, "a");
+    // 18 bytes encoded, the 16 byte ring never holds it
+    if(tm_send_sensor(&tm, &m) || tm_send_sensor(&tm, &m)) ++errors;
+    tm_log(&tm, "b");
+    if(tm_send(&tm, TM_LOG, "x", TM_MAX_PAYLOAD + 1)) ++errors;
+    if(tm.sent != 2 || tm.dropped != 2) ++errors;
+    if(wires[1].decoder.frames != 2 || wires[1].decoder.lost != 2) ++errors;
+    return errors;
+}
+
+// the same sensor readings as frames and as text
+static long bench_sensor(void)
+{
+    tm_channel tm;
+    char text[64];
+
+    uart_setup(0, 0, 0, 115200);
+    tm_init(&tm, 0);
+    tm_decoder_init(&wires[0].decoder, NULL, NULL);
+    wires[0].corrupt_every = 0;
+
+    wires[0].bytes = 0;
+    double start = now_s();
+    for(long i = 0; i < messages; ++i) {
+        tm_sensor m = { (uint32_t) (i * 1000), (int32_t) (i * 7 - 1000), (uint32_t) (i % 4) };
+        tm_send_sensor(&tm, &m);
+    }
+    report("sensor_binary", now_s() - start, wires[0].bytes, wires[0].decoder.frames != messages);
+
+    wires[0].bytes = 0;
+    start = now_s();
+    for(long i = 0; i < messages; ++i) {
+        int n = snprintf(text, sizeof(text), "Sensor %u: %d at %u us\n",
+                         (unsigned) (i % 4), (int) (i * 7 - 1000), (unsigned) (i * 1000));
+        uart_write(0, (const uint8_t *) text, n);
+    }
+    report("sensor_text", now_s() - start, wires[0].bytes, 0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long errors = 0;
+    messages = argc > 1 ? atol(argv[1]) : 1000000;
+    if(messages < 3) messages = 3;
+
+    printf("test,messages,seconds,ns_per_message,wire_bytes_per_message,errors\n");
+    errors += check_crc();
+    errors += check_cobs();
+    errors += check_stream(0);
+    errors += check_stream(97);
+    errors += check_drop();
+    errors += bench_sensor();
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
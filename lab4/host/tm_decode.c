@@ -0,0 +1,55 @@
+// Host decoder for lab4 telemetry frames (telemetry.h): prints one line per message.
+// Reads the serial adapter given as argument, or stdin, until end of file:
+//   stty -F /dev/ttyACM0 raw 115200 && tm_decode /dev/ttyACM0
+//   tm_decode < capture.bin
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "uart_port.h"
+#include "telemetry.h"
+
+// the sending half of telemetry.c is linked in but has no ports to send on
+uart_port *const uart_ports[] = { NULL };
+const int uart_port_count = 0;
+
+static void print_message(void *context, uint8_t id, uint8_t seq, const uint8_t *payload, int len)
+{
+    tm_sensor sensor;
+    tm_motor motor;
+
+    if(id == TM_SENSOR && len == sizeof(sensor)) {
+        memcpy(&sensor, payload, sizeof(sensor));
+        printf("%3u sensor %u: %d at %u us\n", seq, sensor.sensor, sensor.value, sensor.time_us);
+    } else if(id == TM_MOTOR && len == sizeof(motor)) {
+        memcpy(&motor, payload, sizeof(motor));
+        printf("%3u motor %u: position %d target %d at %u us\n", seq, motor.motor, motor.position,
+               motor.target, motor.time_us);
+    } else if(id == TM_LOG) {
+        printf("%3u log: %.*s\n", seq, len, (const char *) payload);
+    } else {
+        printf("%3u id %u, %d bytes\n", seq, id, len);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    tm_decoder decoder;
+    uint8_t buf[256];
+    ssize_t n;
+
+    int fd = argc > 1 ? open(argv[1], O_RDONLY) : STDIN_FILENO;
+    if(fd < 0) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    tm_decoder_init(&decoder, print_message, NULL);
+    while((n = read(fd, buf, sizeof(buf))) > 0) {
+        tm_decode(&decoder, buf, (int) n);
+        fflush(stdout);
+    }
+    fprintf(stderr, "%u frames, %u lost, %u CRC errors, %u framing errors\n", decoder.frames,
+            decoder.lost, decoder.crc_errors, decoder.framing_errors);
+    return EXIT_SUCCESS;
+}
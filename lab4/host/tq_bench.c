@@ -0,0 +1,253 @@
+// Host benchmark for typed_queue against a stand-in for the pico queue_t.
+// The stand-in follows pico_util/queue.c: a spin lock around every add and remove, memcpy of
+// element_size bytes and an index compare for wrapping. Both queues move encoder-sized
+// events (4 bytes) and log-record-sized items (16 bytes) single threaded and between two
+// threads, and typed_queue also with batch removal.
+// Every item must arrive intact and in order.
+//   tq_bench [items_per_test] > results.csv
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "typed_queue.h"
+#include "bench.h"
+
+#define EVENT_QUEUE_SIZE 16
+#define RECORD_QUEUE_SIZE 64
+#define BATCH 16
+
+typedef uint32_t event_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t timestamp;
+    uint8_t data[8];
+} record_t;
+
+TYPED_QUEUE(event_queue, event_t, EVENT_QUEUE_SIZE)
+TYPED_QUEUE(record_queue, record_t, RECORD_QUEUE_SIZE)
+
+// queue_t stand-in
+typedef struct {
+    atomic_flag lock;
+    uint8_t *data;
+    uint16_t wptr;
+    uint16_t rptr;
+    uint16_t element_size;
+    uint16_t element_count;
+} locked_queue;
+
+static void lq_init(locked_queue *q, uint8_t *storage, uint16_t element_size, uint16_t element_count)
+{
+    atomic_flag_clear(&q->lock);
+    q->data = storage;
+    q->wptr = 0;
+    q->rptr = 0;
+    q->element_size = element_size;
+    q->element_count = element_count;
+}
+
+static void lq_lock(locked_queue *q)
+{
+    while(atomic_flag_test_and_set_explicit(&q->lock, memory_order_acquire)) sched_yield();
+}
+
+static void lq_unlock(locked_queue *q)
+{
+    atomic_flag_clear_explicit(&q->lock, memory_order_release);
+}
+
+static uint16_t lq_inc(locked_queue *q, uint16_t index)
+{
+    if(++index > q->element_count) index = 0;
+    return index;
+}
+
+static bool lq_try_add(locked_queue *q, const void *item)
+{
+    bool ok = false;
+    lq_lock(q);
+    if(lq_inc(q, q->wptr) != q->rptr) {
+        memcpy(q->data + q->wptr * q->element_size, item, q->element_size);
+        q->wptr = lq_inc(q, q->wptr);
+        ok = true;
+    }
+    lq_unlock(q);
+    return ok;
+}
+
+static bool lq_try_remove(locked_queue *q, void *item)
+{
+    bool ok = false;
+    lq_lock(q);
+    if(q->rptr != q->wptr) {
+        memcpy(item, q->data + q->rptr * q->element_size, q->element_size);
+        q->rptr = lq_inc(q, q->rptr);
+        ok = true;
+    }
+    lq_unlock(q);
+    return ok;
+}
+
+static long items;
+static event_queue_t events;
+static record_queue_t records;
+static locked_queue lq_events;
+static locked_queue lq_records;
+static uint8_t lq_event_storage[(EVENT_QUEUE_SIZE + 1) * sizeof(event_t)];
+static uint8_t lq_record_storage[(RECORD_QUEUE_SIZE + 1) * sizeof(record_t)];
+
+static void make_event(event_t *e, long seq)
+{
+    *e = (event_t) seq;
+}
+
+static bool check_event(const event_t *e, long seq)
+{
+    return *e == (event_t) seq;
+}
+
+static void make_record(record_t *r, long seq)
+{
+    r->seq = (uint32_t) seq;
+    r->timestamp = (uint32_t) seq * 3;
+    memset(r->data, (uint8_t) seq, sizeof(r->data));
+}
+
+static bool check_record(const record_t *r, long seq)
+{
+    record_t expected;
+    make_record(&expected, seq);
+    return memcmp(r, &expected, sizeof(expected)) == 0;
+}
+
+// producer, consumer, batch consumer and single thread loop for one queue flavour
+#define QUEUE_BENCH(prefix, type, queue, add, remove, make, check) \
+    static void *prefix##_producer(void *arg) \
+    { \
+        type item; \
+        for(long i = 0; i < items; ++i) { \
+            make(&item, i); \
+            while(!add(queue, &item)) sched_yield(); \
+        } \
+        return NULL; \
+    } \
+    \
+    static void *prefix##_consumer(void *arg) \
+    { \
+        type item; \
+        long errors = 0; \
+        for(long i = 0; i < items; ++i) { \
+            while(!remove(queue, &item)) sched_yield(); \
+            if(!check(&item, i)) ++errors; \
+        } \
+        return (void *) errors; \
+    } \
+    \
+    static long prefix##_single(void) \
+    { \
+        type item; \
+        long errors = 0; \
+        for(long i = 0; i < items; i += 8) { \
+            for(int k = 0; k < 8; ++k) { \
+                make(&item, i + k); \
+                add(queue, &item); \
+            } \
+            for(int k = 0; k < 8; ++k) { \
+                remove(queue, &item); \
+                if(!check(&item, i + k)) ++errors; \
+            } \
+        } \
+        return errors; \
+    }
+
+QUEUE_BENCH(tq_event, event_t, &events, event_queue_try_add, event_queue_try_remove, make_event, check_event)
+QUEUE_BENCH(lq_event, event_t, &lq_events, lq_try_add, lq_try_remove, make_event, check_event)
+QUEUE_BENCH(tq_record, record_t, &records, record_queue_try_add, record_queue_try_remove, make_record, check_record)
+QUEUE_BENCH(lq_record, record_t, &lq_records, lq_try_add, lq_try_remove, make_record, check_record)
+
+static void *tq_event_batch_consumer(void *arg)
+{
+    event_t batch[BATCH];
+    long errors = 0;
+    for(long i = 0; i < items; ) {
+        int n = event_queue_remove_batch(&events, batch, BATCH);
+        if(n == 0) sched_yield();
+        for(int k = 0; k < n; ++k, ++i) {
+            if(!check_event(&batch[k], i)) ++errors;
+        }
+    }
+    return (void *) errors;
+}
+
+static void *tq_record_batch_consumer(void *arg)
+{
+    record_t batch[BATCH];
+    long errors = 0;
+    for(long i = 0; i < items; ) {
+        int n = record_queue_remove_batch(&records, batch, BATCH);
+        if(n == 0) sched_yield();
+        for(int k = 0; k < n; ++k, ++i) {
+            if(!check_record(&batch[k], i)) ++errors;
+        }
+    }
+    return (void *) errors;
+}
+
+static void reset(void)
+{
+    event_queue_init(&events);
+    record_queue_init(&records);
+    lq_init(&lq_events, lq_event_storage, sizeof(event_t), EVENT_QUEUE_SIZE);
+    lq_init(&lq_records, lq_record_storage, sizeof(record_t), RECORD_QUEUE_SIZE);
+}
+
+static void report(const char *test, const char *queue, int item_size, double elapsed, long errors)
+{
+    printf("%s,%s,%d,%ld,%.6f,%.0f,%.2f,%ld\n", test, queue, item_size, items, elapsed,
+           items / elapsed, elapsed * 1e9 / items, errors);
+}
+
+static long single(const char *queue, int item_size, long (*fn)(void))
+{
+    reset();
+    double start = now_s();
+    long errors = fn();
+    report("single", queue, item_size, now_s() - start, errors);
+    return errors;
+}
+
+static long threaded(const char *test, const char *queue, int item_size, void *(*producer)(void *), void *(*consumer)(void *))
+{
+    pthread_t p, c;
+    void *errors;
+
+    reset();
+    double start = now_s();
+    pthread_create(&c, NULL, consumer, NULL);
+    pthread_create(&p, NULL, producer, NULL);
+    pthread_join(p, NULL);
+    pthread_join(c, &errors);
+    report(test, queue, item_size, now_s() - start, (long) errors);
+    return (long) errors;
+}
+
+int main(int argc, char **argv)
+{
+    long errors = 0;
+    items = argc > 1 ? atol(argv[1]) : 10000000;
+
+    printf("test,queue,item_size,items,seconds,items_per_s,ns_per_item,errors\n");
+    errors += single("typed_queue", sizeof(event_t), tq_event_single);
+    errors += single("queue_t", sizeof(event_t), lq_event_single);
+    errors += single("typed_queue", sizeof(record_t), tq_record_single);
+    errors += single("queue_t", sizeof(record_t), lq_record_single);
+    errors += threaded("spsc", "typed_queue", sizeof(event_t), tq_event_producer, tq_event_consumer);
+    errors += threaded("spsc", "queue_t", sizeof(event_t), lq_event_producer, lq_event_consumer);
+    errors += threaded("spsc", "typed_queue", sizeof(record_t), tq_record_producer, tq_record_consumer);
+    errors += threaded("spsc", "queue_t", sizeof(record_t), lq_record_producer, lq_record_consumer);
+    errors += threaded("spsc_batch", "typed_queue", sizeof(event_t), tq_event_producer, tq_event_batch_consumer);
+    errors += threaded("spsc_batch", "typed_queue", sizeof(record_t), tq_record_producer, tq_record_batch_consumer);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
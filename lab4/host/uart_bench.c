@@ -0,0 +1,253 @@
+// Host benchmark for the table-driven UART dispatcher.
+// The port table holds host backend ports: transmitted data goes to a per-port sink and
+// received data is injected with uart_host_receive, as the port's interrupt would. Messages
+// are spread round robin over the ports and moved through uart_write, uart_read and
+// uart_read_line; the same work done on the ring buffers directly gives the dispatch overhead.
+// Every port must deliver exactly the data sent through it.
+//   uart_bench [messages_per_test] > results.csv
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uart.h"
+#include "uart_host.h"
+#include "bench.h"
+
+#define PORTS 8
+#define MESSAGE 16
+#define LINE 64
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t checksum;
+} sink_count;
+
+static sink_count sunk[PORTS];
+
+static void sink(void *context, const uint8_t *data, int len)
+{
+    sink_count *c = context;
+    for(int i = 0; i < len; ++i) c->checksum = c->checksum * 31 + data[i];
+    c->bytes += len;
+}
+
+// e.g. LoRa module, debug console, sensor and spare ports
+UART_HOST_PORT(h0, 256, 256, sink, &sunk[0]);
+UART_HOST_PORT(h1, 256, 256, sink, &sunk[1]);
+UART_HOST_PORT(h2, 256, 256, sink, &sunk[2]);
+UART_HOST_PORT(h3, 256, 256, sink, &sunk[3]);
+UART_HOST_PORT(h4, 256, 256, sink, &sunk[4]);
+UART_HOST_PORT(h5, 256, 256, sink, &sunk[5]);
+UART_HOST_PORT(h6, 256, 256, sink, &sunk[6]);
+UART_HOST_PORT(h7, 256, 256, sink, &sunk[7]);
+
+uart_port *const uart_ports[] = { &h0, &h1, &h2, &h3, &h4, &h5, &h6, &h7 };
+const int uart_port_count = sizeof(uart_ports) / sizeof(uart_ports[0]);
+
+static long messages;
+
+static void fill(uint8_t *msg, long seq)
+{
+    for(int i = 0; i < MESSAGE; ++i) msg[i] = (uint8_t) (seq + i);
+}
+
+static void report(const char *test, int ports, double elapsed, long errors)
+{
+    printf("%s,%d,%ld,%.6f,%.2f,%ld\n", test, ports, messages, elapsed, elapsed * 1e9 / messages, errors);
+}
+
+static void setup_all(int ports, bool line_mode)
+{
+    memset(sunk, 0, sizeof(sunk));
+    for(int i = 0; i < ports; ++i) {
+        uart_setup(i, 0, 0, 9600);
+        uart_set_line_mode(i, line_mode);
+    }
+}
+
+static long bench_write(int ports)
+{
+    uint8_t msg[MESSAGE];
+    sink_count expected[PORTS] = { 0 };
+    long errors = 0;
+
+    setup_all(ports, false);
+    double start = now_s();
+    for(long seq = 0; seq < messages; ++seq) {
+        fill(msg, seq);
+        if(uart_write((int) (seq % ports), msg, MESSAGE) != MESSAGE) ++errors;
+    }
+    double elapsed = now_s() - start;
+
+    for(long seq = 0; seq < messages; ++seq) {
+        fill(msg, seq);
+        sink(&expected[seq % ports], msg, MESSAGE);
+    }
+    for(int i = 0; i < ports; ++i) {
+        if(sunk[i].bytes != expected[i].bytes || sunk[i].checksum != expected[i].checksum) ++errors;
+    }
+    report("uart_write", ports, elapsed, errors);
+    return errors;
+}
+
+static long bench_read(int ports)
+{
+    uint8_t msg[MESSAGE], got[MESSAGE];
+    long errors = 0;
+    double elapsed = 0;
+
+    setup_all(ports, false);
+    // receive a batch on every port, then read it back through the dispatcher
+    for(long seq = 0; seq < messages; ) {
+        long batch = seq;
+        for(int k = 0; k < 8 * ports && seq < messages; ++k, ++seq) {
+            fill(msg, seq);
+            uart_host_receive((int) (seq % ports), msg, MESSAGE);
+        }
+        double start = now_s();
+        // each port returns its messages in the order they were received
+        for(long s = batch; s < seq; ++s) {
+            fill(msg, s);
+            if(uart_read((int) (s % ports), got, MESSAGE) != MESSAGE || memcmp(got, msg, MESSAGE) != 0) ++errors;
+        }
+        elapsed += now_s() - start;
+    }
+    report("uart_read", ports, elapsed, errors);
+    return errors;
+}
+
+static long bench_lines(int ports)
+{
+    char line[LINE], got[LINE];
+    long errors = 0;
+    double elapsed = 0;
+
+    setup_all(ports, true);
+    for(long seq = 0; seq < messages; ) {
+        long batch = seq;
+        for(int k = 0; k < 4 * ports && seq < messages; ++k, ++seq) {
+            int len = snprintf(line, sizeof(line), "+MSG: %ld\r\n", seq);
+            uart_host_receive((int) (seq % ports), (const uint8_t *) line, len);
+        }
+        double start = now_s();
+        for(long s = batch; s < seq; ++s) {
+            if(uart_read_line((int) (s % ports), (uint8_t *) got, LINE, 0, NULL) < 0) ++errors;
+            snprintf(line, sizeof(line), "+MSG: %ld\r\n", s);
+            if(strcmp(line, got) != 0) ++errors;
+        }
+        elapsed += now_s() - start;
+    }
+    report("uart_read_line", ports, elapsed, errors);
+    return errors;
+}
+
+// the same ring buffer work without the port table, for comparison
+static long bench_direct(void)
+{
+    uint8_t msg[MESSAGE];
+    long errors = 0;
+    ring_buffer *rb = &uart_ports[0]->tx;
+    sink_count count = { 0 };
+
+    setup_all(1, false);
+    double start = now_s();
+    for(long seq = 0; seq < messages; ++seq) {
+        fill(msg, seq);
+        if(rb_write(rb, msg, MESSAGE) != MESSAGE) ++errors;
+        const uint8_t *span;
+        int n;
+        while((n = rb_peek_read(rb, &span)) > 0) {
+            sink(&count, span, n);
+            rb_consume(rb, n);
+        }
+    }
+    report("rb_write_direct", 1, now_s() - start, errors);
+    return errors;
+}
+
+// counters kept by the dispatcher: byte counts, ring drops and write stalls
+static long check_stats(void)
+{
+    uint8_t data[300] = { 0 };
+    uart_stats stats;
+    long errors = 0;
+
+    setup_all(2, false);
+    uart_write(0, data, 100);
+    // more than the 256 byte rx ring holds
+    uart_host_receive(1, data, 200);
+    uart_host_receive(1, data, 100);
+    uart_get_stats(0, &stats);
+    if(stats.tx_bytes != 100 || stats.rx_bytes != 0 || stats.tx_stalls != 0) ++errors;
+    uart_get_stats(1, &stats);
+    if(stats.rx_bytes != 300 || stats.rx_dropped != 44 || stats.tx_bytes != 0) ++errors;
+    // the host backend transmits at once, so a write only stalls if it is larger than the ring
+    uart_write(0, data, 300);
+    uart_get_stats(0, &stats);
+    if(stats.tx_stalls != 1 || stats.tx_bytes != 356) ++errors;
+    // reset by uart_setup
+    uart_setup(1, 0, 0, 9600);
+    uart_get_stats(1, &stats);
+    if(stats.rx_bytes != 0 || stats.rx_dropped != 0 || stats.isr_calls != 0) ++errors;
+    return errors;
+}
+
+// RTS follows the rx ring: deasserted at 3/4 full, asserted again once read down to 1/4
+static long check_flow(void)
+{
+    uint8_t data[200] = { 0 };
+    uart_stats stats;
+    long errors = 0;
+
+    setup_all(1, false);
+    if(!uart_set_flow_control(0, -1, 0) || !h0_state.rts) ++errors;
+    uart_host_receive(0, data, 150);
+    if(!h0_state.rts) ++errors;
+    uart_host_receive(0, data, 50);
+    if(h0_state.rts) ++errors;
+    // still above the low watermark
+    uart_read(0, data, 100);
+    if(h0_state.rts) ++errors;
+    uart_read(0, data, 50);
+    if(!h0_state.rts) ++errors;
+    uart_host_receive(0, data, 200);
+    uart_read(0, data, 200);
+    uart_get_stats(0, &stats);
+    if(stats.rts_deasserts != 2 || stats.rx_dropped != 0 || !h0_state.rts) ++errors;
+    // turned off by uart_setup
+    uart_setup(0, 0, 0, 9600);
+    uart_host_receive(0, data, 200);
+    if(!h0_state.rts) ++errors;
+    return errors;
+}
+
+static long bench_invalid(void)
+{
+    uint8_t buf[4];
+    long errors = 0;
+    // unknown numbers used to fall through to UART1
+    if(uart_write(-1, buf, 4) != 0 || uart_write(PORTS, buf, 4) != 0) ++errors;
+    if(uart_read(PORTS, buf, 4) != 0 || uart_read_line(PORTS, buf, 4, 0, NULL) != -1) ++errors;
+    if(uart_count() != PORTS) ++errors;
+    if(uart_set_speed(PORTS, 115200) != 0) ++errors;
+    if(uart_set_speed(0, 115200) != 115200 || h0_state.speed != 115200) ++errors;
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    static const int port_counts[] = { 1, 3, 8 };
+    long errors = 0;
+    messages = argc > 1 ? atol(argv[1]) : 1000000;
+
+    printf("test,ports,messages,seconds,ns_per_message,errors\n");
+    errors += bench_direct();
+    for(int i = 0; i < sizeof(port_counts) / sizeof(port_counts[0]); ++i) {
+        errors += bench_write(port_counts[i]);
+        errors += bench_read(port_counts[i]);
+        errors += bench_lines(port_counts[i]);
+    }
+    errors += check_stats();
+    errors += check_flow();
+    errors += bench_invalid();
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+// Host test for the UART RX DMA publishing path.
+// A simulated DMA channel copies recorded LoRa module traffic into the rx ring storage one
+// byte per UART character time, wrapping at the ring size like the RP2040 DMA ring mode,
+// and counts down its transfer count; a short run makes the completion interrupt restart
+// it now and then. The RX tick runs every TICK character times and publishes with
+// rx_dma_tick as the driver's timer does, feeding the line discipline with the stamp.
+// Lines read long after they arrived must still carry their arrival time.
+// The consumer reads at irregular intervals, also while the channel has written bytes that
+// are not published yet. While it keeps up every byte must arrive in order; in a second run
+// the consumer stalls and the loss must be fully accounted for, with every byte it does get
+// matching what was sent at that position.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "uart_dma.h"
+#include "line_disc.h"
+#include "bench.h"
+
+#define RB_SIZE 256
+#define EXPECTED 4096   // sent bytes kept for comparison, more than the ring holds
+#define RUN 1000        // transfers per channel run, RX_DMA_RUN on the device
+#define TICK 3          // character times per RX tick (32 bit times)
+#define CHAR_US 1042    // one character at 9600 baud
+
+// responses captured from the module, sent back to back in bursts
+static const char *recorded[] = {
+    "OK\r\n",
+    "+AT: OK\r\n",
+    "+VER: 4.0.11\r\n",
+    "+ID: DevEui, 2C:F7:F1:20:32:30:A5:70\r\n",
+    "+ID: DevAddr, 42:00:2F:A5\r\n+ID: DevEui, 2C:F7:F1:20:32:30:A5:70\r\n+ID: AppEui, 80:00:00:00:00:00:00:06\r\n",
+    "+MODE: LWOTAA\r\n",
+    "+JOIN: Start\r\n+JOIN: NORMAL\r\n+JOIN: Network joined\r\n+JOIN: NetID 000000 DevAddr 42:00:2F:A5\r\n+JOIN: Done\r\n",
+};
+
+static uint8_t storage[RB_SIZE];
+static ring_buffer rx;
+static rx_dma rxd;
+static uint32_t dma_offset;             // simulated channel write address, relative to storage
+static volatile uint32_t dma_remaining; // simulated transfer count register
+static long chars;                      // character times since start
+static line_disc ld;
+
+static void start(void)
+{
+    rb_init(&rx, storage, RB_SIZE);
+    rb_set_overwrite(&rx, true);
+    dma_offset = 0;
+    dma_remaining = RUN;
+    rx_dma_init(&rxd, &rx, &dma_remaining, RUN);
+    ld_init(&ld, &rx);
+    chars = 0;
+}
+
+static uint64_t now_us(void)
+{
+    return (uint64_t) chars * CHAR_US;
+}
+
+// one character time: the channel may store a byte, the tick may run
+static void char_time(const uint8_t *c)
+{
+    if(c) {
+        storage[dma_offset] = *c;
+        dma_offset = (dma_offset + 1) & (RB_SIZE - 1);
+        if(--dma_remaining == 0) {
+            // completion interrupt
+            dma_remaining = RUN;
+            rx_dma_restarted(&rxd);
+        }
+    }
+    ++chars;
+    uint64_t time_us;
+    if(chars % TICK == 0 && rx_dma_tick(&rxd, now_us(), &time_us) > 0) ld_scan(&ld, time_us);
+}
+
+static void receive(const void *data, int len)
+{
+    for(int i = 0; i < len; ++i) char_time((const uint8_t *) data + i);
+}
+
+// the n bytes just read end at the ring's tail, each must be what was sent at its position
+static long check_read(const uint8_t *buf, int n, const uint8_t *expected)
+{
+    uint32_t position = atomic_load(&rx.tail) - (uint32_t) n;
+    long errors = 0;
+    for(int k = 0; k < n; ++k, ++position) {
+        if(buf[k] != expected[position % EXPECTED]) ++errors;
+    }
+    return errors;
+}
+
+// stall_every: 0 for a consumer that keeps up, otherwise the consumer stops reading for
+// half of every stall_every bursts
+static long run(long bursts, int stall_every)
+{
+    static uint8_t expected[EXPECTED];
+    long expected_len = 0;
+    long sent = 0;
+    long received = 0;
+    long errors = 0;
+    uint8_t buf[64];
+
+    start();
+    for(long b = 0; b < bursts; ++b) {
+        const char *burst = recorded[next_random() % (sizeof(recorded) / sizeof(recorded[0]))];
+        int len = (int) strlen(burst);
+        bool stalled = stall_every != 0 && b % stall_every < stall_every / 2;
+        for(int i = 0; i < len; ++i) {
+            expected[(sent++) % EXPECTED] = (uint8_t) burst[i];
+            char_time((const uint8_t *) burst + i);
+            // the main loop gets to run now and then while the burst is arriving
+            if(next_random() % 8 == 0 && !stalled) {
+                int n = rb_read(&rx, buf, 1 + next_random() % sizeof(buf));
+                errors += check_read(buf, n, expected);
+                received += n;
+            }
+        }
+        // line idle for a while, at least two ticks
+        for(int i = next_random() % 8; i < 2 * TICK + 8; ++i) char_time(NULL);
+        expected_len = sent;
+    }
+    // drain
+    int n;
+    while((n = rb_read(&rx, buf, sizeof(buf))) > 0) {
+        errors += check_read(buf, n, expected);
+        received += n;
+    }
+
+    if(received + (long) rx.overwritten != expected_len) ++errors;
+    if(stall_every == 0 && rx.overwritten != 0) ++errors;
+    if(stall_every != 0 && rx.overwritten == 0) ++errors;
+    printf("rx_dma %s sent %ld received %ld overwritten %u peak %u errors %ld\n",
+           stall_every ? "stalled" : "keeping up", expected_len, received, rx.overwritten, rx.peak, errors);
+    return errors;
+}
+
+// A line is published by the first tick that finds the line idle, not while it arrives;
+// a stream without pauses is published every quarter ring.
+static long check_publish(void)
+{
+    uint8_t stream[RB_SIZE];
+    long errors = 0;
+
+    start();
+    receive("+AT: OK\r\n", 9);
+    if(atomic_load(&rx.head) != 0) ++errors;
+    while(atomic_load(&rx.head) == 0 && chars < 9 + 2 * TICK) char_time(NULL);
+    if(atomic_load(&rx.head) != 9 || chars > 9 + 2 * TICK) ++errors;
+    long line_chars = chars;
+
+    memset(stream, 'x', sizeof(stream));
+    receive(stream, sizeof(stream));
+    // never more than a quarter ring (and a tick) behind
+    uint32_t behind = rx_dma_position(&rxd) - atomic_load(&rx.head);
+    if(behind > RB_SIZE / 4 + TICK) ++errors;
+    printf("rx_dma publish: line after %ld chars, stream %u bytes behind, errors %ld\n", line_chars, behind, errors);
+    return errors;
+}
+
+// A full ring is published, then the channel writes 40 more bytes over the oldest ones
+// before the next tick. A read of everything must skip those 40 and count them as
+// overwritten (with the byte the channel writes next) rather than return them as old data.
+static long check_ahead(void)
+{
+    uint8_t sent[RB_SIZE + 40], buf[RB_SIZE];
+    long errors = 0;
+
+    start();
+    for(int i = 0; i < (int) sizeof(sent); ++i) sent[i] = (uint8_t) next_random();
+    receive(sent, RB_SIZE);
+    for(int i = 0; i < 2 * TICK; ++i) char_time(NULL);
+    // no tick while the 40 arrive
+    for(int i = 0; i < 40; ++i) {
+        storage[dma_offset] = sent[RB_SIZE + i];
+        dma_offset = (dma_offset + 1) & (RB_SIZE - 1);
+        --dma_remaining;
+    }
+    int n = rb_read(&rx, buf, RB_SIZE);
+    if(n != RB_SIZE - 41 || rx.overwritten != 41 || memcmp(buf, sent + 41, n) != 0) ++errors;
+    for(int i = 0; i < 2 * TICK; ++i) char_time(NULL);
+    n = rb_read(&rx, buf, RB_SIZE);
+    if(n != 40 || memcmp(buf, sent + RB_SIZE, 40) != 0) ++errors;
+    printf("rx_dma ahead of head: overwritten %u errors %ld\n", rx.overwritten, errors);
+    return errors;
+}
+
+// Answers arrive after a varying delay and the main loop only looks every 50 ms. Each
+// line must be stamped at most one tick after its last byte arrived, not when it was read.
+static long check_stamps(void)
+{
+    long errors = 0;
+    uint8_t line[64];
+    uint64_t stamp, worst = 0;
+
+    start();
+    for(int i = 0; i < 200; ++i) {
+        const char *answer = recorded[1 + i % 3];
+        int len = (int) strlen(answer);
+        for(int k = next_random() % 40; k > 0; --k) char_time(NULL);
+        receive(answer, len);
+        uint64_t arrived = now_us();
+        // main loop busy elsewhere
+        while(now_us() < arrived + 50000) char_time(NULL);
+        if(ld_read(&ld, line, sizeof(line), &stamp) != len || memcmp(line, answer, len) != 0) ++errors;
+        if(stamp < arrived || stamp - arrived > TICK * CHAR_US) ++errors;
+        else if(stamp - arrived > worst) worst = stamp - arrived;
+        if(ld_count(&ld) != 0) ++errors;
+    }
+    printf("rx_dma stamps: read 50000 us late, stamped at most %llu us after arrival, errors %ld\n",
+           (unsigned long long) worst, errors);
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    long bursts = argc > 1 ? atol(argv[1]) : 100000;
+    seed_random(777);
+    long errors = check_publish();
+    errors += check_stamps();
+    errors += check_ahead();
+    errors += run(bursts, 0);
+    errors += run(bursts, 40);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+// Host test for the UART TX DMA state machine.
+// The DMA channel is simulated: a started transfer is remembered and "completes" later,
+// at which point its bytes are appended to the wire output and tx_dma_complete runs as
+// the completion interrupt would. Writers and completions are interleaved pseudo-randomly.
+// Checks that the wire carries exactly the written stream, that a transfer is never started
+// while one is in flight and that every transfer is a span inside the ring storage.
+// Also reports the CPU cost per byte and the average transfer length.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uart_dma.h"
+#include "bench.h"
+
+#define RB_SIZE 256
+
+typedef struct {
+    const uint8_t *src;
+    int len;
+    long starts;
+    long errors;
+} sim_dma;
+
+static uint8_t storage[RB_SIZE];
+static ring_buffer tx;
+static tx_dma txd;
+static sim_dma dma;
+
+static void sim_start(void *context, const uint8_t *src, int len)
+{
+    sim_dma *d = context;
+    if(d->len != 0) ++d->errors;                                    // double start
+    if(src < storage || src + len > storage + RB_SIZE) ++d->errors; // not a ring span
+    d->src = src;
+    d->len = len;
+    ++d->starts;
+}
+
+int main(int argc, char **argv)
+{
+    long total = argc > 1 ? atol(argv[1]) : 10000000;
+    seed_random(12345);
+    long written = 0;
+    long received = 0;
+    long errors = 0;
+    uint8_t chunk[64];
+
+    rb_init(&tx, storage, RB_SIZE);
+    tx_dma_init(&txd, &tx, sim_start, &dma);
+
+    double start = now_s();
+    while(received < total) {
+        if(written < total && next_random() % 3 != 0) {
+            // writer: queue a chunk as uart_write does
+            int n = 1 + next_random() % sizeof(chunk);
+            if(n > total - written) n = (int) (total - written);
+            for(int i = 0; i < n; ++i) chunk[i] = (uint8_t) (written + i);
+            written += rb_write(&tx, chunk, n);
+            tx_dma_kick(&txd);
+        }
+        else if(dma.len > 0) {
+            // channel finished: check the bytes that went out, then run the completion interrupt
+            for(int i = 0; i < dma.len; ++i) {
+                if(dma.src[i] != (uint8_t) (received + i)) ++errors;
+            }
+            received += dma.len;
+            dma.len = 0;
+            tx_dma_complete(&txd);
+        }
+    }
+    double elapsed = now_s() - start;
+
+    errors += dma.errors;
+    if(tx_dma_busy(&txd) || !rb_empty(&tx)) ++errors;
+    printf("tx_dma %ld bytes %ld transfers %.1f bytes/transfer %.2f ns/byte errors %ld\n",
+           received, dma.starts, (double) received / dma.starts, elapsed * 1e9 / received, errors);
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
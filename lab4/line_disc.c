@@ -0,0 +1,63 @@
+//
+// Line discipline: the receive interrupt records where lines end, readers fetch whole lines.
+//
+#include <string.h>
+#include "line_disc.h"
+
+void ld_init(line_disc *ld, ring_buffer *rb)
+{
+    ld->rb = rb;
+    rx_line_queue_init(&ld->lines);
+    ld->scanned = atomic_load_explicit(&rb->head, memory_order_acquire);
+    ld->line_start = ld->scanned;
+    ld->dropped = 0;
+}
+
+int ld_scan(line_disc *ld, uint64_t time_us)
+{
+    ring_buffer *rb = ld->rb;
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    int lines = 0;
+
+    // in overwrite mode only the newest capacity bytes are still in storage
+    if(head - ld->scanned > rb->mask + 1) ld->scanned = head - (rb->mask + 1);
+    while(ld->scanned != head) {
+        uint32_t start = ld->scanned & rb->mask;
+        uint32_t n = rb->mask + 1 - start;
+        if(n > head - ld->scanned) n = head - ld->scanned;
+        const uint8_t *end = memchr(rb->buffer + start, '\n', n);
+        if(!end) {
+            ld->scanned += n;
+            continue;
+        }
+        ld->scanned += (uint32_t) (end - (rb->buffer + start)) + 1;
+        rx_line line = { ld->line_start, ld->scanned - ld->line_start, time_us };
+        if(rx_line_queue_try_add(&ld->lines, &line)) ++lines;
+        else ++ld->dropped;
+        ld->line_start = ld->scanned;
+    }
+    return lines;
+}
+
+int ld_count(line_disc *ld)
+{
+    return rx_line_queue_count(&ld->lines);
+}
+
+int ld_read(line_disc *ld, uint8_t *buf, int max, uint64_t *time_us)
+{
+    rx_line line;
+    if(max <= 0 || !rx_line_queue_try_remove(&ld->lines, &line)) return -1;
+    if(time_us) *time_us = line.time_us;
+
+    // bytes before the line belong to dropped lines or predate ld_init
+    rb_discard_to(ld->rb, line.start);
+    // after an overwrite the tail may already be inside the line
+    uint32_t end = line.start + line.length;
+    int32_t remaining = (int32_t) (end - atomic_load_explicit(&ld->rb->tail, memory_order_relaxed));
+    int n = 0;
+    if(remaining > 0) n = rb_read(ld->rb, buf, remaining < max - 1 ? remaining : max - 1);
+    rb_discard_to(ld->rb, end);
+    buf[n] = '\0';
+    return n;
+}
@@ -0,0 +1,57 @@
+//
+// Line discipline: the receive interrupt records where lines end, readers fetch whole lines.
+//
+
+#ifndef UART_IRQ_LINE_DISC_H
+#define UART_IRQ_LINE_DISC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring_buffer.h"
+#include "typed_queue.h"
+
+// completed lines not yet read, must be a power of two
+#ifndef LD_QUEUE_SIZE
+#define LD_QUEUE_SIZE 16
+#endif
+
+// A received line: start is the free running ring buffer index of its first byte (compare
+// with head/tail, mask it to get the storage offset), length includes the CR/LF. time_us is
+// when its terminator arrived as far as the receive interrupt can tell, see ld_scan: on the
+// hardware UART within one RX tick (32 bit times), see rx_dma_tick.
+typedef struct {
+    uint32_t start;
+    uint32_t length;
+    uint64_t time_us;
+} rx_line;
+
+TYPED_QUEUE(rx_line_queue, rx_line, LD_QUEUE_SIZE)
+
+// The producer of the ring buffer (the UART interrupt) calls ld_scan after publishing data;
+// only the new bytes are searched for '\n', once. The consumer then takes lines from the
+// queue and copies each one out of the ring without searching it again.
+// Lines are kept in the ring, so the queue holds only descriptors. A line whose bytes were
+// overwritten before it was read comes back truncated; one that did not fit in the queue is
+// skipped and counted in dropped.
+typedef struct {
+    ring_buffer *rb;
+    rx_line_queue_t lines;
+    uint32_t scanned;       // producer: index up to which line ends have been searched
+    uint32_t line_start;    // producer: start of the line being received
+    uint32_t dropped;       // producer: lines lost because the queue was full
+} line_disc;
+
+// start recording lines from the current ring head, older data is skipped by ld_read
+void ld_init(line_disc *ld, ring_buffer *rb);
+// producer side: record the lines completed by bytes published since the last call,
+// returns the number queued. time_us is when the newest of those bytes arrived; lines
+// completed earlier in the same batch get the same stamp.
+int ld_scan(line_disc *ld, uint64_t time_us);
+// consumer side: number of complete lines waiting
+int ld_count(line_disc *ld);
+// copy the next complete line to buf and release its bytes in the ring, -1 if there is none.
+// buf is NUL terminated; a line longer than max - 1 bytes is truncated and the rest discarded.
+// Stores the line's arrival time in *time_us unless time_us is NULL.
+int ld_read(line_disc *ld, uint8_t *buf, int max, uint64_t *time_us);
+
+#endif //UART_IRQ_LINE_DISC_H
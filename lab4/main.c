@@ -1,70 +1,266 @@
-#include <ctype.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "uart.h"
-
-#define STRLEN 80 // Maximum length for the response string
+#include "baud_store.h"
+#include "uart_stdio.h"
+#include "at_engine.h"
+#include "at_parse.h"
 
 // UART configuration settings
 #define UART_NR 1           // Using UART1
 #define UART_TX_PIN 4       // Pin 4 is configured as UART TX
 #define UART_RX_PIN 5       // Pin 5 is configured as UART RX
 #define BAUD_RATE 9600      // UART communication speed set to 9600 baud
+#define FAST_BAUD_RATE 115200 // Speed negotiated with the module once it answers
+#define MODULE_RESET_MS 300 // Time for the module to restart after AT+RESET
 
-// Function to send an AT command to the LoRa module and wait for a response
-int send_command(const char *command, char *response_buffer, int maxlen, int max_attempts) {
-    int attempt = 0;         // Tracks the number of attempts made
-    int response_len = 0;    // Length of the response received
-
-    // Loop to retry sending the command up to max_attempts
-    while (attempt < max_attempts) {
-        uart_send(UART_NR, command);  // Send the command via UART
-        uint32_t start_time = time_us_32();
-        response_len = 0;
-
-        // Wait for data to become readable and process the response
-        while ((time_us_32() - start_time) <= 500000) { // 500 ms timeout
-            char c;
-            if (uart_read(UART_NR, (uint8_t *)&c, 1) == 1) { // Read 1 character
-                if (response_len < maxlen - 1) { // Buffer limit is not exceeded
-                    response_buffer[response_len++] = c; // Store character in the response buffer
-                    if (c == '\n') { // Stop reading if a line feed is found
-                        response_buffer[response_len] = '\0'; // Null-terminate the response
-                        return 1; // Valid response received
-                    }
-                }
-            }
-        }
+// Console on UART0, printf goes through the interrupt-driven tx ring instead of blocking
+#define CONSOLE_UART_NR 0
+#define CONSOLE_TX_PIN 0
+#define CONSOLE_RX_PIN 1
+#define CONSOLE_BAUD_RATE 115200
+
+#define LATENCY_BUCKETS 10  // Response latency histogram: under 1, 2, 4 ... 256 ms, then 256 ms and over
+
+int current_baud = BAUD_RATE; // Speed the UART is running at
+uint32_t last_latency_us = 0; // Module response time of the last successful command
+uint32_t response_latency[LATENCY_BUCKETS]; // Number of responses in each latency bucket
+
+// Count a response latency in its power-of-two millisecond bucket
+void record_latency(uint32_t latency_us) {
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && latency_us >= (1000u << bucket)) {
+        bucket++;
+    }
+    response_latency[bucket]++;
+    last_latency_us = latency_us;
+}
+
+// Print the response latency histogram
+void print_latency(void) {
+    printf("Response latency:");
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        printf(" <%dms %u", 1 << i, response_latency[i]);
+    }
+    printf(" >=%dms %u\n", 1 << (LATENCY_BUCKETS - 2), response_latency[LATENCY_BUCKETS - 1]);
+}
+
+// Print driver counters and ring buffer occupancy for the LoRa UART
+void print_uart_stats(void) {
+    uart_stats stats;
+    uart_get_stats(UART_NR, &stats);
+    printf("UART%d in %u out %u bytes, OE %u BE %u PE %u FE %u, rx dropped %u, tx stalls %u\n",
+           UART_NR, stats.rx_bytes, stats.tx_bytes, stats.overrun, stats.breaks, stats.parity,
+           stats.framing, stats.rx_dropped, stats.tx_stalls);
+    printf("UART%d isr %u calls, cycles min %u avg %u max %u\n",
+           UART_NR, stats.isr_calls, stats.isr_cycles_min, stats.isr_cycles_avg, stats.isr_cycles_max);
+    printf("UART%d flow control: RTS deasserted %u times, CTS stalls %u\n",
+           UART_NR, stats.rts_deasserts, stats.cts_stalls);
+
+    rb_stats rx, tx;
+    uart_get_buffer_stats(UART_NR, &rx, &tx);
+    printf("UART%d rx: %d/%d peak %d dropped %u overwritten %u\n",
+           UART_NR, rx.count, rx.capacity, rx.peak, rx.dropped, rx.overwritten);
+    printf("UART%d tx: %d/%d peak %d dropped %u\n",
+           UART_NR, tx.count, tx.capacity, tx.peak, tx.dropped);
+    printf("Console dropped %u bytes\n", uart_stdio_dropped());
+}
+
+at_engine at; // Sends commands to the module one at a time without blocking the main loop
+bool sequence_running = false; // The command sequence started by SW_0 is in progress
+bool probed_other = false;     // The probe has already tried the other of BAUD_RATE and FAST_BAUD_RATE
+uint32_t restart_delay_ms = 0; // The module was reset, the next command waits for it to restart
+int module_baud = 0;           // Rate being set on the module
+at_callback module_baud_done;  // Called when the module has been given module_baud
 
-        attempt++; // Increment the attempt counter if no response is received
+// Commands sent to the module and the start of the line that answers each of them
+typedef enum {
+    CMD_AT,
+    CMD_VERSION,
+    CMD_DEVEUI,
+    CMD_UART_BR,
+    CMD_RESET,
+} module_command;
+
+static const struct {
+    const char *command;  // printf format for commands that take a value
+    const char *prefix;
+    int attempts;
+} commands[] = {
+    [CMD_AT] = { "AT\r\n", "+AT:", 5 },
+    [CMD_VERSION] = { "AT+VER\r\n", "+VER:", 5 },
+    [CMD_DEVEUI] = { "AT+ID=DEVEUI\r\n", "+ID: DevEui", 5 },
+    [CMD_UART_BR] = { "AT+UART=BR, %d\r\n", "+UART:", 3 },
+    [CMD_RESET] = { "AT+RESET\r\n", "+RESET:", 1 }, // Answered before the restart
+};
+
+// Queue a command from the table, done is called from at_poll when the module answers
+// or all attempts have timed out
+void send_command(module_command id, int value, at_callback done) {
+    char command[AT_COMMAND_MAX];
+    snprintf(command, sizeof(command), commands[id].command, value);
+    at_request request = {
+        .command = command, // Copied by at_submit
+        .prefix = commands[id].prefix,
+        .timeout_us = 500000, // Each attempt waits 500 ms for the answer
+        .attempts = commands[id].attempts,
+        .delay_us = restart_delay_ms * 1000,
+        .done = done,
+    };
+    restart_delay_ms = 0;
+    if (!at_submit(&at, &request)) {
+        printf("AT queue full, %s dropped\n", command);
+    }
+}
+
+// True if the module answered, its response time goes into the histogram
+bool answered(const at_response *response) {
+    if (response->result != AT_TIMEOUT) {
+        record_latency(response->latency_us); // Taken by the receive interrupt, not when the main loop looked
+    }
+    return response->result == AT_OK;
+}
+
+// A query in the sequence failed: no answer, an error, or an answer that does not parse
+void report_failure(const at_response *response) {
+    if (response->result == AT_TIMEOUT) {
+        printf("Module stopped responding\n");
+    } else {
+        printf("Unexpected answer: %s\n", response->line);
     }
+}
+
+// Lines the module sends on its own
+void print_unsolicited(void *context, const char *line, int length) {
+    printf("Module: %s\n", line);
+}
+
+// Switch the UART to a new speed, data already sent goes out at the old speed first
+void set_baud_rate(int baud) {
+    uart_set_speed(UART_NR, baud);
+    current_baud = baud;
+}
+
+void on_module_reset(void *context, const at_response *response) {
+    set_baud_rate(module_baud); // The module restarts at the new rate whether or not the answer came through
+    restart_delay_ms = MODULE_RESET_MS;
+    at_response changed = *response;
+    changed.result = AT_OK;
+    module_baud_done(context, &changed);
+}
 
-    return 0; // Failure: No response after max_attempts
+void on_module_baud(void *context, const at_response *response) {
+    if (!answered(response) || strncmp(response->line, "+UART: BR", 9) != 0) {
+        module_baud_done(context, response); // Module did not accept the rate
+        return;
+    }
+    send_command(CMD_RESET, 0, on_module_reset);
 }
 
-// Function to process the DevEui response (received from the LoRa module)
-void format_deveui(const char *devEui) {
-    char processedDevEui[60]; // Buffer to store the processed DevEui
+// Change the module's UART speed. The module stores the rate and switches to it after a reset.
+// done gets AT_OK once both ends run at the new rate.
+void set_module_baud_rate(int baud, at_callback done) {
+    module_baud = baud;
+    module_baud_done = done;
+    send_command(CMD_UART_BR, baud, on_module_baud);
+}
 
-    // Iterate through the input string, skipping colons
-    for (int i = 0, j = 0; i < 59; ++i) {
-        if (devEui[i] != ':') { // Skip colon characters
-            processedDevEui[j++] = tolower(devEui[i]); // Convert to lowercase and store
+void on_deveui(void *context, const at_response *response) {
+    uint8_t eui[AT_EUI_SIZE];
+    if (answered(response) && at_parse_deveui(response->line, response->length, eui)) {
+        printf("DevEui: ");
+        for (int i = 0; i < AT_EUI_SIZE; i++) {
+            printf("%02x", eui[i]);
         }
+        printf("\n");
+        print_latency(); // Module response times so far
+    } else {
+        report_failure(response);
+    }
+    sequence_running = false; // Wait for SW_0 again
+}
+
+void on_version(void *context, const at_response *response) {
+    at_version version;
+    if (answered(response) && at_parse_version(response->line, response->length, &version)) {
+        printf("Firmware Version (%u us): %u.%u.%u\n", last_latency_us,
+               version.major, version.minor, version.patch); // Print firmware version and response time
+        send_command(CMD_DEVEUI, 0, on_deveui);
+    } else {
+        report_failure(response);
+        sequence_running = false;
+    }
+}
+
+// Save the working rate for the next boot and carry on with the module queries
+void negotiation_done(void) {
+    baud_store_save(current_baud); // Flash is only written when the rate changes
+    send_command(CMD_VERSION, 0, on_version);
+}
+
+void on_fallback(void *context, const at_response *response) {
+    set_baud_rate(BAUD_RATE);
+    printf("Staying at %d baud\n", BAUD_RATE);
+    negotiation_done();
+}
+
+void on_verify(void *context, const at_response *response) {
+    if (answered(response)) {
+        printf("Link raised to %d baud\n", FAST_BAUD_RATE);
+        negotiation_done();
+    } else {
+        set_module_baud_rate(BAUD_RATE, on_fallback); // Module took the new rate but does not answer at it
+    }
+}
+
+void on_raised(void *context, const at_response *response) {
+    if (response->result == AT_OK) {
+        send_command(CMD_AT, 0, on_verify); // Check that the module still answers
+    } else {
+        on_fallback(context, response);
+    }
+}
+
+// Raise the link to FAST_BAUD_RATE and verify that the module still answers.
+// On failure both ends go back to BAUD_RATE. The working rate is saved for the next boot.
+void negotiate_baud_rate(void) {
+    if (current_baud == FAST_BAUD_RATE) {
+        negotiation_done();
+    } else {
+        set_module_baud_rate(FAST_BAUD_RATE, on_raised);
+    }
+}
+
+void on_probe(void *context, const at_response *response) {
+    if (answered(response)) {
+        printf("--- connecting ---\n");
+        printf("Connected to LoRa module\n"); // Success message
+        negotiate_baud_rate(); // Speed up the rest of the session
+    } else if (!probed_other) {
+        // The module may have been reset to its default rate, or kept FAST_BAUD_RATE while the stored rate was lost
+        set_baud_rate(current_baud == BAUD_RATE ? FAST_BAUD_RATE : BAUD_RATE);
+        probed_other = true;
+        send_command(CMD_AT, 0, on_probe);
+    } else { // If no response after 5 attempts
+        printf("Module not responding\n");
+        print_uart_stats(); // Show whether bytes were lost in the driver
+        sequence_running = false;
     }
-    processedDevEui[59] = '\0'; // Null-terminate the processed DevEui
+}
 
-    printf("DevEui: %s\n", processedDevEui); // Print the processed DevEui
+// Check that the module answers, at the current speed first and then once at the other known rate
+void probe_module(void) {
+    probed_other = false;
+    send_command(CMD_AT, 0, on_probe);
 }
 
-// Main function implementing the state machine
+// Main function: the module conversation runs from at_poll, so the loop never waits on it
 int main() {
     const uint led_gpio = 22;   // GPIO pin for LED (not actively used here)
     const uint button_gpio = 7; // GPIO pin for the button (SW_0)
 
-    int current_state = 0;      // Variable to track the current state of the program
-
     // Initialize the LED pin as output
     gpio_init(led_gpio);
     gpio_set_dir(led_gpio, GPIO_OUT);
@@ -74,54 +270,30 @@ int main() {
     gpio_set_dir(button_gpio, GPIO_IN);
     gpio_pull_up(button_gpio);
 
-    // Initialize UART and standard input/output
+    // Initialize UART and standard input/output, at the rate negotiated on an earlier boot if there is one
     stdio_init_all();
-    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE);
+    uart_setup(CONSOLE_UART_NR, CONSOLE_TX_PIN, CONSOLE_RX_PIN, CONSOLE_BAUD_RATE);
+    uart_stdio_init(CONSOLE_UART_NR, UART_STDIO_DROP_COUNT); // Never stall the state machine on printf
+    int stored_baud = baud_store_load(); // Reads flash on the device
+    if (stored_baud > 0) {
+        current_baud = stored_baud;
+    }
+    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, current_baud);
+    uart_set_line_mode(UART_NR, true); // The module answers in CR/LF terminated lines
+    at_init(&at, UART_NR, print_unsolicited, NULL);
 
     printf("Boot\n"); // Print a message to indicate the program has started
 
-    char response_buffer[STRLEN]; // Buffer to hold UART responses
-
-    // Infinite loop for the state machine
     while (true) {
-        switch (current_state) {
-            case 0: // Waiting for the user to press SW_0
-                while (gpio_get(button_gpio)) { // Poll the button state
-                    sleep_ms(10); // Debounce delay
-                }
-                current_state = 1; // Transition to State 1 ensures program only runs when the user is ready.
-                break;
-
-            case 1: // Send "AT" command to check connectivity
-                if (send_command("AT\r\n", response_buffer, STRLEN, 5)) { // Try sending the command
-                    printf("--- connecting ---\n");
-                    printf("Connected to LoRa module\n"); // Success message
-                    current_state = 2; // Move to next state
-                } else { // If no response after 5 attempts
-                    printf("Module not responding\n");
-                    current_state = 0; // Return to initial state
-                }
-                break;
-
-            case 2: // Send "AT+VER" command to get firmware version
-                if (send_command("AT+VER\r\n", response_buffer, STRLEN, 5)) { // Try sending the command
-                    printf("Firmware Version: %s\n", response_buffer); // Print firmware version
-                    current_state = 3; // Move to next state
-                } else { // If no response after 5 attempts
-                    printf("Module stopped responding\n");
-                    current_state = 0; // Return to initial state
-                }
-                break;
-
-            case 3: // Send "AT+ID=DEVEUI" command to get DevEui
-                if (send_command("AT+ID=DEVEUI\r\n", response_buffer, STRLEN, 5)) { // Try sending the command
-                    format_deveui(response_buffer); // Process and print the DevEui
-                    current_state = 0; // Return to initial state
-                } else { // If no response after 5 attempts
-                    printf("Module stopped responding\n");
-                    current_state = 0; // Return to initial state
-                }
-                break;
+        at_poll(&at, time_us_64()); // Match answers, handle timeouts and send the next command
+
+        // SW_0 starts the sequence: AT (and speed negotiation), AT+VER, AT+ID=DEVEUI
+        if (!sequence_running && !gpio_get(button_gpio)) {
+            sequence_running = true;
+            probe_module();
         }
+
+        // Other work (buttons, motors, logging) goes here, nothing in this loop blocks on the module
+        uart_wait_line(UART_NR, 10000); // Sleep until the module answers, at most 10 ms
     }
 }
@@ -1,56 +1,316 @@
 //
 // Created by keijo on 4.11.2023.
 //
-#include <stdlib.h>
+#include <string.h>
 #include "ring_buffer.h"
 
+// Memory ordering:
+// The producer fills a slot and then publishes it with a release store to head.
+// The consumer reads head with acquire before touching the slot, and releases the slot
+// back to the producer with a release store to tail. Each side reads its own index relaxed.
+//
+// Overwrite-oldest mode:
+// The producer skips the space check and may lap the consumer. The consumer resyncs its tail
+// to the oldest byte still in storage, and after copying re-reads head to discard bytes that
+// the producer may have overwritten while they were being read. Only the consumer moves tail,
+// so the buffer stays lock-free. A producer that stores ahead of head (RX DMA) reports its
+// real position through write_position, otherwise its unpublished bytes would pass as intact.
+
+static uint32_t round_down_pow2(uint32_t n)
+{
+    while(n & (n - 1)) n &= n - 1;
+    return n;
+}
+
+// producer side: remember the highest occupancy and check the high watermark
+static void rb_produced(ring_buffer *rb, uint32_t before, uint32_t after)
+{
+    if(after > rb->mask + 1) after = rb->mask + 1;
+    if(after > rb->peak) rb->peak = after;
+    if(rb->on_watermark && before < rb->high_mark && after >= rb->high_mark) {
+        rb->on_watermark(RB_EVENT_HIGH, rb->context);
+    }
+}
+
+// consumer side: check the low watermark
+static void rb_consumed(ring_buffer *rb, uint32_t before, uint32_t after)
+{
+    if(rb->on_watermark && before > rb->low_mark && after <= rb->low_mark) {
+        rb->on_watermark(RB_EVENT_LOW, rb->context);
+    }
+}
+
+// consumer side: number of readable bytes from *tail, skipping data the producer has lapped
+static uint32_t rb_readable(ring_buffer *rb, uint32_t *tail)
+{
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    uint32_t available = head - *tail;
+    if(available > rb->mask + 1) {
+        uint32_t lost = available - (rb->mask + 1);
+        rb->overwritten += lost;
+        *tail += lost;
+        available -= lost;
+    }
+    return available;
+}
+
+// consumer side: number of bytes from tail onwards that may have been overwritten while reading
+static uint32_t rb_torn(ring_buffer *rb, uint32_t tail)
+{
+    if(!rb->overwrite) return 0;
+    atomic_thread_fence(memory_order_acquire);
+    uint32_t written = rb->write_position ? rb->write_position(rb->position_context)
+                                          : atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t oldest_intact = written - rb->mask;
+    int32_t torn = (int32_t) (oldest_intact - tail);
+    return torn > 0 ? (uint32_t) torn : 0;
+}
 
 void rb_init(ring_buffer *rb, uint8_t *buffer, int size)
 {
-    rb->tail = 0;
-    rb->head = 0;
-    rb->size = size;
+    atomic_init(&rb->tail, 0);
+    atomic_init(&rb->head, 0);
+    rb->mask = size > 0 ? round_down_pow2((uint32_t) size) - 1 : 0;
     rb->buffer = buffer;
+    rb->overwrite = false;
+    rb->peak = 0;
+    rb->dropped = 0;
+    rb->overwritten = 0;
+    rb->high_mark = UINT32_MAX;
+    rb->low_mark = UINT32_MAX;
+    rb->on_watermark = NULL;
+    rb->context = NULL;
+    rb->write_position = NULL;
+    rb->position_context = NULL;
+}
+
+void rb_set_watermarks(ring_buffer *rb, int low, int high, rb_watermark_cb cb, void *context)
+{
+    rb->on_watermark = NULL;
+    rb->context = context;
+    rb->low_mark = low < 0 ? UINT32_MAX : (uint32_t) low;
+    rb->high_mark = high < 0 ? UINT32_MAX : (uint32_t) high;
+    rb->on_watermark = cb;
+}
+
+void rb_set_write_position(ring_buffer *rb, rb_position_fn position, void *context)
+{
+    rb->write_position = NULL;
+    rb->position_context = context;
+    rb->write_position = position;
+}
+
+void rb_set_overwrite(ring_buffer *rb, bool overwrite)
+{
+    rb->overwrite = overwrite;
+}
+
+void rb_get_stats(ring_buffer *rb, rb_stats *stats)
+{
+    stats->capacity = rb_capacity(rb);
+    stats->count = rb_count(rb);
+    stats->peak = (int) rb->peak;
+    stats->dropped = rb->dropped;
+    stats->overwritten = rb->overwritten;
 }
 
 bool rb_empty(ring_buffer *rb)
 {
-    return rb->head == rb->tail;
+    return atomic_load_explicit(&rb->head, memory_order_acquire) ==
+           atomic_load_explicit(&rb->tail, memory_order_acquire);
 }
 
 bool rb_full(ring_buffer *rb)
 {
-    return (rb->head + 1) % rb->size == rb->tail;
+    return atomic_load_explicit(&rb->head, memory_order_acquire) -
+           atomic_load_explicit(&rb->tail, memory_order_acquire) > rb->mask;
+}
+
+int rb_count(ring_buffer *rb)
+{
+    uint32_t used = atomic_load_explicit(&rb->head, memory_order_acquire) -
+                    atomic_load_explicit(&rb->tail, memory_order_acquire);
+    // in overwrite mode head may be ahead by more than the capacity until the consumer resyncs
+    return (int) (used > rb->mask ? rb->mask + 1 : used);
+}
+
+int rb_capacity(ring_buffer *rb)
+{
+    return (int) rb->mask + 1;
 }
 
 bool rb_put(ring_buffer *rb, uint8_t data)
 {
-    // calculate new head (position where to store the value)
-    int nh = (rb->head + 1) % rb->size;
-    // return false if buffer would be full
-    if(nh == rb->tail) return false;
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    // return false if buffer is full
+    if(head - tail > rb->mask && !rb->overwrite) {
+        ++rb->dropped;
+        return false;
+    }
 
-    rb->buffer[rb->head] = data;
-    rb->head = nh;
+    rb->buffer[head & rb->mask] = data;
+    atomic_store_explicit(&rb->head, head + 1, memory_order_release);
+    rb_produced(rb, head - tail, head + 1 - tail);
     return true;
 }
 
 uint8_t rb_get(ring_buffer *rb)
 {
-    uint8_t value = rb->buffer[rb->tail];
-    if(rb->head != rb->tail) {
-        rb->tail = (rb->tail + 1) % rb->size;
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t available;
+    uint8_t value;
+    for(;;) {
+        // caller is expected to check rb_empty first
+        if((available = rb_readable(rb, &tail)) == 0) {
+            atomic_store_explicit(&rb->tail, tail, memory_order_release);
+            return 0;
+        }
+        value = rb->buffer[tail & rb->mask];
+        if(!rb_torn(rb, tail)) break;
+        ++rb->overwritten;
+        ++tail;
     }
+    atomic_store_explicit(&rb->tail, tail + 1, memory_order_release);
+    rb_consumed(rb, available, available - 1);
     return value;
 }
 
-void rb_alloc(ring_buffer *rb, int size)
+int rb_write(ring_buffer *rb, const uint8_t *src, int n)
+{
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    uint32_t used = head - tail;
+    uint32_t space = used > rb->mask ? 0 : rb->mask + 1 - used;
+    uint32_t count = n > 0 ? (uint32_t) n : 0;
+    if(rb->overwrite) {
+        // only the newest capacity bytes can survive
+        if(count > rb->mask + 1) {
+            rb->dropped += count - (rb->mask + 1);
+            src += count - (rb->mask + 1);
+            count = rb->mask + 1;
+        }
+    }
+    else if(count > space) {
+        rb->dropped += count - space;
+        count = space;
+    }
+    if(count == 0) return 0;
+
+    // first region runs up to the end of the storage, second one wraps to the start
+    uint32_t start = head & rb->mask;
+    uint32_t first = rb->mask + 1 - start;
+    if(first > count) first = count;
+    memcpy(rb->buffer + start, src, first);
+    memcpy(rb->buffer, src + first, count - first);
+
+    atomic_store_explicit(&rb->head, head + count, memory_order_release);
+    rb_produced(rb, used, used + count);
+    return (int) count;
+}
+
+// consumer side: copy count bytes from tail out and release them
+static int rb_copy_out(ring_buffer *rb, uint8_t *dst, uint32_t tail, uint32_t available, uint32_t count)
+{
+    uint32_t start = tail & rb->mask;
+    uint32_t first = rb->mask + 1 - start;
+    if(first > count) first = count;
+    memcpy(dst, rb->buffer + start, first);
+    memcpy(dst + first, rb->buffer, count - first);
+
+    uint32_t torn = rb_torn(rb, tail);
+    if(torn > 0) {
+        // drop the bytes that were overwritten during the copy
+        if(torn > count) torn = count;
+        memmove(dst, dst + torn, count - torn);
+        rb->overwritten += torn;
+        tail += torn;
+        count -= torn;
+    }
+
+    atomic_store_explicit(&rb->tail, tail + count, memory_order_release);
+    rb_consumed(rb, available, available - count);
+    return (int) count;
+}
+
+int rb_read(ring_buffer *rb, uint8_t *dst, int n)
+{
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t available = rb_readable(rb, &tail);
+    uint32_t count = n > 0 ? (uint32_t) n : 0;
+    if(count > available) count = available;
+    return rb_copy_out(rb, dst, tail, available, count);
+}
+
+int rb_read_until(ring_buffer *rb, uint8_t *dst, int n, int delim)
+{
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t available = rb_readable(rb, &tail);
+    uint32_t count = n > 0 ? (uint32_t) n : 0;
+    if(count > available) count = available;
+
+    // look for the delimiter in the same two regions the copy uses
+    uint32_t start = tail & rb->mask;
+    uint32_t first = rb->mask + 1 - start;
+    if(first > count) first = count;
+    const uint8_t *end = memchr(rb->buffer + start, delim, first);
+    if(end) count = (uint32_t) (end - (rb->buffer + start)) + 1;
+    else if((end = memchr(rb->buffer, delim, count - first))) count = first + (uint32_t) (end - rb->buffer) + 1;
+    return rb_copy_out(rb, dst, tail, available, count);
+}
+
+int rb_discard_to(ring_buffer *rb, uint32_t end)
+{
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t available = rb_readable(rb, &tail);
+    uint32_t count = end - tail;
+    // already past end: nothing to do, but keep a resync done by rb_readable
+    if((int32_t) count < 0) count = 0;
+    if(count > available) count = available;
+    atomic_store_explicit(&rb->tail, tail + count, memory_order_release);
+    rb_consumed(rb, available, available - count);
+    return (int) count;
+}
+
+int rb_reserve_write(ring_buffer *rb, uint8_t **span)
 {
-    uint8_t  *buffer = calloc(size, sizeof(uint8_t));
-    rb_init(rb, buffer, size);
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    uint32_t used = head - tail;
+    uint32_t space = used > rb->mask ? 0 : rb->mask + 1 - used;
+    uint32_t start = head & rb->mask;
+    uint32_t contiguous = rb->mask + 1 - start;
+
+    *span = rb->buffer + start;
+    return (int) (space < contiguous ? space : contiguous);
+}
+
+void rb_commit_write(ring_buffer *rb, int n)
+{
+    // n must not exceed the length returned by rb_reserve_write, unless in overwrite mode
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    atomic_store_explicit(&rb->head, head + (uint32_t) n, memory_order_release);
+    rb_produced(rb, head - tail, head + (uint32_t) n - tail);
+}
+
+int rb_peek_read(ring_buffer *rb, const uint8_t **span)
+{
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    uint32_t available = head - tail;
+    uint32_t start = tail & rb->mask;
+    uint32_t contiguous = rb->mask + 1 - start;
+
+    *span = rb->buffer + start;
+    return (int) (available < contiguous ? available : contiguous);
 }
 
-void rb_free(ring_buffer *rb)
+void rb_consume(ring_buffer *rb, int n)
 {
-    free(rb->buffer);
+    // n must not exceed the length returned by rb_peek_read
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    atomic_store_explicit(&rb->tail, tail + (uint32_t) n, memory_order_release);
+    rb_consumed(rb, head - tail, head - tail - (uint32_t) n);
 }
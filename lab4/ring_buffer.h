@@ -7,21 +7,142 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
+typedef enum {
+    RB_EVENT_HIGH,  // occupancy rose to the high watermark (called from the producer)
+    RB_EVENT_LOW    // occupancy dropped to the low watermark (called from the consumer)
+} rb_event;
+
+typedef void (*rb_watermark_cb)(rb_event event, void *context);
+// free running index the producer stores next, see rb_set_write_position
+typedef uint32_t (*rb_position_fn)(void *context);
+
+// Single-producer / single-consumer ring buffer.
+// head and tail are free running counters: only the producer writes head and only the
+// consumer writes tail, so no locking or interrupt masking is needed between an ISR
+// and the main loop. The capacity is a power of two and indices wrap with a mask.
 typedef struct  {
-    int head;
-    int tail;
-    int size;
+    _Atomic uint32_t head;  // next position to write, owned by the producer
+    _Atomic uint32_t tail;  // next position to read, owned by the consumer
+    uint32_t mask;          // capacity - 1
     uint8_t *buffer;
+    bool overwrite;         // overwrite-oldest policy instead of dropping new data when full
+    uint32_t peak;          // highest occupancy seen, updated by the producer
+    uint32_t dropped;       // bytes refused because the buffer was full, updated by the producer
+    uint32_t overwritten;   // bytes lost to overwrite-oldest, updated by the consumer
+    uint32_t high_mark;     // watermark levels, UINT32_MAX when disabled
+    uint32_t low_mark;
+    rb_watermark_cb on_watermark;
+    void *context;
+    rb_position_fn write_position;  // producer that stores ahead of head (DMA), NULL if none
+    void *position_context;
 } ring_buffer;
 
+typedef struct {
+    int capacity;
+    int count;
+    int peak;
+    uint32_t dropped;
+    uint32_t overwritten;
+} rb_stats;
+
+// Statically allocated ring buffers. Storage goes to .bss, the capacity is a compile time
+// constant and a size that is not a power of two is a compile error, so nothing needs
+// to be allocated or initialised at boot.
+//   RB_DEFINE(log_rb, 128);                        -> static ring_buffer log_rb with 128 bytes
+//                                                     and inline log_rb_put/log_rb_get
+//   RB_STORAGE(rx_buf, 256); ... = RB_STATIC_INIT(rx_buf)  -> for ring buffers inside structs
+#define RB_STORAGE(name, size) \
+    _Static_assert((size) > 0 && ((size) & ((size) - 1)) == 0, #name " size must be a power of two"); \
+    static uint8_t name[(size)]
+
+// same, aligned to its own size as the DMA address wrap (ring) feature requires
+#define RB_STORAGE_DMA(name, size) \
+    _Static_assert((size) > 0 && ((size) & ((size) - 1)) == 0, #name " size must be a power of two"); \
+    static uint8_t name[(size)] __attribute__((aligned(size)))
+
+#define RB_STATIC_INIT(storage) { .head = 0, .tail = 0, .mask = sizeof(storage) - 1, .buffer = (storage), \
+                                  .high_mark = UINT32_MAX, .low_mark = UINT32_MAX }
+
+// RB_DEFINE also defines name_put(data) and name_get(), rb_put_fixed/rb_get_fixed with the
+// capacity filled in.
+#define RB_DEFINE(name, size) \
+    RB_STORAGE(name##_storage, size); \
+    static ring_buffer name; \
+    static inline bool name##_put(uint8_t data) { return rb_put_fixed(&name, data, (size)); } \
+    static inline uint8_t name##_get(void) { return rb_get_fixed(&name, (size)); } \
+    static ring_buffer name = RB_STATIC_INIT(name##_storage)
+
+// size must be a power of two, other values are rounded down to one
 void rb_init(ring_buffer *rb, uint8_t *buffer, int size);
 bool rb_empty(ring_buffer *rb);
 bool rb_full(ring_buffer *rb);
+int rb_count(ring_buffer *rb);
+int rb_capacity(ring_buffer *rb);
 bool rb_put(ring_buffer *rb, uint8_t data);
 uint8_t rb_get(ring_buffer *rb);
+// When enabled the producer never fails: if the consumer falls behind the oldest data is
+// lost and counted in overwritten. Zero-copy peek/consume must not be used in this mode.
+void rb_set_overwrite(ring_buffer *rb, bool overwrite);
+// For a producer that stores bytes before publishing them, such as a DMA channel writing
+// into the storage on its own: position returns the free running index it stores next
+// (head or ahead of it). In overwrite mode readers then trust only the bytes that position
+// has not lapped, not everything behind head. Pass NULL to go back to head.
+void rb_set_write_position(ring_buffer *rb, rb_position_fn position, void *context);
+// Call cb when occupancy rises from below high to high or more (RB_EVENT_HIGH) and when it
+// drops from above low to low or less (RB_EVENT_LOW). Pass a negative level to disable an
+// event. The callback runs in the context of whoever moved the data, often an ISR, so it
+// should only set a flag or signal an event.
+void rb_set_watermarks(ring_buffer *rb, int low, int high, rb_watermark_cb cb, void *context);
+// snapshot of occupancy and loss counters, safe to call from either side
+void rb_get_stats(ring_buffer *rb, rb_stats *stats);
+// copy up to n bytes in or out with at most two memcpy calls, return number of bytes copied
+int rb_write(ring_buffer *rb, const uint8_t *src, int n);
+int rb_read(ring_buffer *rb, uint8_t *dst, int n);
+// same as rb_read but stops after the first delim byte, which is copied
+int rb_read_until(ring_buffer *rb, uint8_t *dst, int n, int delim);
+// discard everything before the free running index end, for example the end of a line whose
+// position the producer recorded from head. Works in overwrite mode. Returns the bytes discarded.
+int rb_discard_to(ring_buffer *rb, uint32_t end);
+// zero-copy access: get the largest contiguous writable (readable) span of the storage,
+// work on it in place and then commit (consume) the number of bytes actually used.
+// Only the producer may reserve/commit and only the consumer may peek/consume.
+int rb_reserve_write(ring_buffer *rb, uint8_t **span);
+void rb_commit_write(ring_buffer *rb, int n);
+int rb_peek_read(ring_buffer *rb, const uint8_t **span);
+void rb_consume(ring_buffer *rb, int n);
+
+// Inline single byte fast paths for a ring whose capacity is a compile time constant, which
+// must be the capacity the ring was set up with. Same semantics as rb_put and rb_get, but
+// the wrap mask is an immediate instead of a load of rb->mask and there is no call.
+// Overwrite mode and watermarks take the out of line path. Bulk transfers are dominated
+// by memcpy, use rb_write and rb_read for them.
+static inline bool rb_put_fixed(ring_buffer *rb, uint8_t data, uint32_t capacity)
+{
+    if(rb->overwrite || rb->on_watermark) return rb_put(rb, data);
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    if(head - tail >= capacity) {
+        ++rb->dropped;
+        return false;
+    }
+    rb->buffer[head & (capacity - 1)] = data;
+    atomic_store_explicit(&rb->head, head + 1, memory_order_release);
+    if(head + 1 - tail > rb->peak) rb->peak = head + 1 - tail;
+    return true;
+}
 
-void rb_alloc(ring_buffer *rb, int size);
-void rb_free(ring_buffer *rb);
+static inline uint8_t rb_get_fixed(ring_buffer *rb, uint32_t capacity)
+{
+    if(rb->overwrite || rb->on_watermark) return rb_get(rb);
+    uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    // caller is expected to check rb_empty first
+    if(head == tail) return 0;
+    uint8_t value = rb->buffer[tail & (capacity - 1)];
+    atomic_store_explicit(&rb->tail, tail + 1, memory_order_release);
+    return value;
+}
 
 #endif //UART_IRQ_RING_BUFFER_H
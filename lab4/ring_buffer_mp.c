@@ -0,0 +1,59 @@
+//
+// Multi-producer front end for ring_buffer.
+//
+#include "ring_buffer_mp.h"
+
+#if !PICO_ON_DEVICE
+#include <sched.h>
+#endif
+
+static uint32_t mp_lock(mp_ring_buffer *mp)
+{
+#if PICO_ON_DEVICE
+    return spin_lock_blocking(mp->lock);
+#else
+    while(atomic_flag_test_and_set_explicit(&mp->lock, memory_order_acquire)) sched_yield();
+    return 0;
+#endif
+}
+
+static void mp_unlock(mp_ring_buffer *mp, uint32_t save)
+{
+#if PICO_ON_DEVICE
+    spin_unlock(mp->lock, save);
+#else
+    atomic_flag_clear_explicit(&mp->lock, memory_order_release);
+#endif
+}
+
+void rb_mp_init(mp_ring_buffer *mp, uint8_t *buffer, int size)
+{
+    rb_init(&mp->rb, buffer, size);
+#if PICO_ON_DEVICE
+    mp->lock = spin_lock_instance(spin_lock_claim_unused(true));
+#else
+    atomic_flag_clear(&mp->lock);
+#endif
+}
+
+bool rb_mp_put(mp_ring_buffer *mp, uint8_t data)
+{
+    uint32_t save = mp_lock(mp);
+    bool ok = rb_put(&mp->rb, data);
+    mp_unlock(mp, save);
+    return ok;
+}
+
+bool rb_mp_write(mp_ring_buffer *mp, const uint8_t *src, int n)
+{
+    bool ok = false;
+    uint32_t save = mp_lock(mp);
+    if(mp->rb.overwrite || rb_capacity(&mp->rb) - rb_count(&mp->rb) >= n) {
+        ok = rb_write(&mp->rb, src, n) == n;
+    }
+    else {
+        mp->rb.dropped += n;
+    }
+    mp_unlock(mp, save);
+    return ok;
+}
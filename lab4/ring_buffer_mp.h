@@ -0,0 +1,35 @@
+//
+// Multi-producer front end for ring_buffer.
+//
+
+#ifndef UART_IRQ_RING_BUFFER_MP_H
+#define UART_IRQ_RING_BUFFER_MP_H
+
+#include "ring_buffer.h"
+
+#if PICO_ON_DEVICE
+#include "hardware/sync.h"
+#endif
+
+// Any number of producers (GPIO callbacks, UART ISRs, the main loop, the second core) may
+// write. Producers serialise on a short critical section around the copy: a hardware
+// spin lock with interrupts disabled on the RP2040, a spinning atomic flag on the host.
+// There is still exactly one consumer, which uses the normal lock-free read API on
+// the embedded ring buffer: rb_read(&mp->rb, ...), rb_get(&mp->rb), rb_peek_read(&mp->rb, ...).
+typedef struct {
+    ring_buffer rb;
+#if PICO_ON_DEVICE
+    spin_lock_t *lock;
+#else
+    atomic_flag lock;
+#endif
+} mp_ring_buffer;
+
+// size must be a power of two, other values are rounded down to one
+void rb_mp_init(mp_ring_buffer *mp, uint8_t *buffer, int size);
+bool rb_mp_put(mp_ring_buffer *mp, uint8_t data);
+// all or nothing: either n bytes are written contiguously in the stream or none,
+// so records from different producers never interleave
+bool rb_mp_write(mp_ring_buffer *mp, const uint8_t *src, int n);
+
+#endif //UART_IRQ_RING_BUFFER_MP_H
@@ -0,0 +1,111 @@
+//
+// Sleep until a receive ring buffer has data instead of polling it.
+//
+#include "rx_wait.h"
+
+#if PICO_ON_DEVICE
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+typedef absolute_time_t rx_deadline;
+#else
+#include <errno.h>
+#include <time.h>
+
+typedef struct timespec rx_deadline;
+#endif
+
+void rx_wait_init(rx_wait *w)
+{
+#if !PICO_ON_DEVICE
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+#endif
+}
+
+void rx_wait_signal(rx_wait *w)
+{
+#if PICO_ON_DEVICE
+    __sev();
+#else
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+#endif
+}
+
+static rx_deadline rx_wait_deadline(uint32_t timeout_us)
+{
+#if PICO_ON_DEVICE
+    return make_timeout_time_us(timeout_us);
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_us / 1000000;
+    deadline.tv_nsec += (long) (timeout_us % 1000000) * 1000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+#endif
+}
+
+static bool rx_wait_until(rx_wait *w, bool (*ready)(void *arg), void *arg, rx_deadline deadline)
+{
+#if PICO_ON_DEVICE
+    while(!ready(arg)) {
+        if(time_reached(deadline)) return false;
+        // returns at once if the producer signalled since the last __wfe
+        best_effort_wfe_or_timeout(deadline);
+    }
+    return true;
+#else
+    pthread_mutex_lock(&w->lock);
+    while(!ready(arg)) {
+        if(pthread_cond_timedwait(&w->cond, &w->lock, &deadline) == ETIMEDOUT) break;
+    }
+    bool result = ready(arg);
+    pthread_mutex_unlock(&w->lock);
+    return result;
+#endif
+}
+
+static bool rx_wait_rb_readable(void *arg)
+{
+    return !rb_empty(arg);
+}
+
+bool rx_wait_for(rx_wait *w, bool (*ready)(void *arg), void *arg, uint32_t timeout_us)
+{
+    if(ready(arg)) return true;
+    // a poll, do not touch the clock or the lock
+    if(timeout_us == 0) return false;
+    return rx_wait_until(w, ready, arg, rx_wait_deadline(timeout_us));
+}
+
+bool rx_wait_readable(rx_wait *w, ring_buffer *rb, uint32_t timeout_us)
+{
+    return rx_wait_for(w, rx_wait_rb_readable, rb, timeout_us);
+}
+
+int rx_wait_read_until(rx_wait *w, ring_buffer *rb, uint8_t *buf, int max, int delim, uint32_t timeout_us)
+{
+    // the timeout covers the whole line, not each wait
+    rx_deadline deadline = rx_wait_deadline(timeout_us);
+    int len = 0;
+
+    if(max <= 0) return 0;
+    while(len < max - 1) {
+        // rb_read_until rather than peek/consume, the UART rx ring is in overwrite mode
+        int n = rb_read_until(rb, buf + len, max - 1 - len, delim);
+        if(n == 0) {
+            if(!rx_wait_until(w, rx_wait_rb_readable, rb, deadline)) break;
+            continue;
+        }
+        len += n;
+        if(buf[len - 1] == delim) break;
+    }
+    buf[len] = '\0';
+    return len;
+}
@@ -0,0 +1,40 @@
+//
+// Sleep until a receive ring buffer has data instead of polling it.
+//
+
+#ifndef UART_IRQ_RX_WAIT_H
+#define UART_IRQ_RX_WAIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring_buffer.h"
+
+#if !PICO_ON_DEVICE
+#include <pthread.h>
+#endif
+
+// The producer (the UART interrupt on the device, a feeding thread on the host) calls
+// rx_wait_signal after publishing data to the ring. On the device the waiter parks the core
+// with __wfe and the signal is __sev, so a signal sent between the empty check and the
+// __wfe is not lost. On the host the same is done with a condition variable. The waiter
+// does not wake up until it is signalled or its timeout passes.
+typedef struct {
+#if !PICO_ON_DEVICE
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+} rx_wait;
+
+void rx_wait_init(rx_wait *w);
+void rx_wait_signal(rx_wait *w);
+// sleep until ready(arg) returns true or timeout_us passes, returns the last ready(arg).
+// ready is re-checked after every signal, the producer must make it true before signalling.
+bool rx_wait_for(rx_wait *w, bool (*ready)(void *arg), void *arg, uint32_t timeout_us);
+// sleep until rb has data or timeout_us passes, true if data is available
+bool rx_wait_readable(rx_wait *w, ring_buffer *rb, uint32_t timeout_us);
+// read from rb into buf until delim (stored), until max - 1 bytes are stored or until
+// timeout_us passes, whichever comes first. buf is NUL terminated. Returns the number of
+// bytes stored, check the last one to tell a complete line from a timeout.
+int rx_wait_read_until(rx_wait *w, ring_buffer *rb, uint8_t *buf, int max, int delim, uint32_t timeout_us);
+
+#endif //UART_IRQ_RX_WAIT_H
@@ -0,0 +1,138 @@
+//
+// Binary telemetry over a lab4 UART: COBS framed, CRC checked, typed messages.
+//
+#include <string.h>
+#include "uart.h"
+#include "telemetry.h"
+
+// computeCRC16 from lab_5_2 with the x << 12 term of the polynomial it leaves out
+uint16_t tm_crc16(const uint8_t *data, int len)
+{
+    uint16_t crc = 0xFFFF;
+    while(len--) {
+        uint8_t x = crc >> 8 ^ *data++;
+        x ^= x >> 4;
+        crc = (crc << 8) ^ ((uint16_t) (x << 12)) ^ ((uint16_t) (x << 5)) ^ ((uint16_t) x);
+    }
+    return crc;
+}
+
+int tm_cobs_encode(const uint8_t *src, int len, uint8_t *dst)
+{
+    int code_at = 0;    // where the length code of the current block goes
+    int out = 1;
+    uint8_t code = 1;
+
+    for(int i = 0; i < len; ++i) {
+        if(src[i] != 0) {
+            dst[out++] = src[i];
+            ++code;
+        }
+        // a zero, or a full block of 254 non-zero bytes, ends the block
+        if(src[i] == 0 || code == 0xFF) {
+            dst[code_at] = code;
+            code_at = out++;
+            code = 1;
+        }
+    }
+    dst[code_at] = code;
+    return out;
+}
+
+int tm_cobs_decode(const uint8_t *src, int len, uint8_t *dst)
+{
+    int in = 0;
+    int out = 0;
+
+    while(in < len) {
+        uint8_t code = src[in++];
+        if(code == 0 || in + code - 1 > len) return -1;
+        // dst never overtakes src, so decoding in place is safe
+        for(int i = 1; i < code; ++i) dst[out++] = src[in++];
+        if(code != 0xFF && in < len) dst[out++] = 0;
+    }
+    return out;
+}
+
+void tm_init(tm_channel *tm, int uart_nr)
+{
+    tm->uart_nr = uart_nr;
+    tm->seq = 0;
+    tm->sent = 0;
+    tm->dropped = 0;
+}
+
+bool tm_send(tm_channel *tm, uint8_t id, const void *payload, int len)
+{
+    uint8_t raw[TM_MAX_RAW];
+    uint8_t frame[TM_MAX_FRAME];
+
+    if(len < 0 || len > TM_MAX_PAYLOAD) return false;
+    raw[0] = id;
+    raw[1] = tm->seq++;
+    memcpy(raw + 2, payload, len);
+    uint16_t crc = tm_crc16(raw, len + 2);
+    raw[len + 2] = (uint8_t) (crc >> 8);
+    raw[len + 3] = (uint8_t) crc;
+    int n = tm_cobs_encode(raw, len + 4, frame);
+    frame[n++] = 0;
+
+    // a partial frame would be lost together with the next one
+    if(uart_tx_free(tm->uart_nr) < n) {
+        ++tm->dropped;
+        return false;
+    }
+    uart_write(tm->uart_nr, frame, n);
+    ++tm->sent;
+    return true;
+}
+
+bool tm_log(tm_channel *tm, const char *text)
+{
+    int len = 0;
+    while(len < TM_MAX_PAYLOAD && text[len]) ++len;
+    return tm_send(tm, TM_LOG, text, len);
+}
+
+void tm_decoder_init(tm_decoder *d, tm_handler handler, void *context)
+{
+    memset(d, 0, sizeof(*d));
+    d->last_seq = -1;
+    d->handler = handler;
+    d->context = context;
+}
+
+static void tm_frame(tm_decoder *d)
+{
+    int n = tm_cobs_decode(d->buf, d->len, d->buf);
+    if(n < 4) {
+        ++d->framing_errors;
+        return;
+    }
+    uint16_t crc = (uint16_t) (d->buf[n - 2] << 8 | d->buf[n - 1]);
+    if(tm_crc16(d->buf, n - 2) != crc) {
+        ++d->crc_errors;
+        return;
+    }
+    uint8_t seq = d->buf[1];
+    if(d->last_seq >= 0) d->lost += (uint8_t) (seq - d->last_seq - 1);
+    d->last_seq = seq;
+    ++d->frames;
+    if(d->handler) d->handler(d->context, d->buf[0], seq, d->buf + 2, n - 4);
+}
+
+void tm_decode(tm_decoder *d, const uint8_t *data, int len)
+{
+    for(int i = 0; i < len; ++i) {
+        if(data[i] != 0) {
+            if(d->len < TM_MAX_FRAME) d->buf[d->len++] = data[i];
+            else d->overflow = true;
+            continue;
+        }
+        // zero: end of frame, consecutive zeros are idle fill
+        if(d->overflow) ++d->framing_errors;
+        else if(d->len > 0) tm_frame(d);
+        d->len = 0;
+        d->overflow = false;
+    }
+}
@@ -0,0 +1,93 @@
+//
+// Binary telemetry over a lab4 UART: COBS framed, CRC checked, typed messages.
+//
+
+#ifndef UART_IRQ_TELEMETRY_H
+#define UART_IRQ_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A frame is id, seq, payload, CRC16 (CRC-16/CCITT-FALSE over id, seq and payload, high byte
+// first), COBS encoded so it contains no zero bytes, followed by a zero delimiter. A receiver
+// that starts mid stream or sees a corrupted frame resynchronises at the next zero.
+// Payloads are sent as they are in memory: both the RP2040 and the host are little endian.
+#define TM_MAX_PAYLOAD 64
+#define TM_MAX_RAW (TM_MAX_PAYLOAD + 4)
+#define TM_MAX_FRAME (TM_MAX_RAW + TM_MAX_RAW / 254 + 2)
+
+// message ids
+enum {
+    TM_LOG = 1,         // text, not NUL terminated
+    TM_SENSOR = 2,      // tm_sensor
+    TM_MOTOR = 3,       // tm_motor
+};
+
+typedef struct {
+    uint32_t time_us;   // time_us_32() when sampled
+    int32_t value;
+    uint32_t sensor;    // application defined channel
+} tm_sensor;
+
+typedef struct {
+    uint32_t time_us;
+    int32_t position;   // steps
+    int32_t target;
+    uint32_t motor;
+} tm_motor;
+
+_Static_assert(sizeof(tm_sensor) == 12, "tm_sensor has padding");
+_Static_assert(sizeof(tm_motor) == 16, "tm_motor has padding");
+
+// sending side, one per UART port; only one writer may use the port
+typedef struct {
+    int uart_nr;
+    uint8_t seq;        // per frame, also advanced for dropped frames so the receiver sees the gap
+    uint32_t sent;
+    uint32_t dropped;   // frames that did not fit in the tx ring
+} tm_channel;
+
+void tm_init(tm_channel *tm, int uart_nr);
+// queue one frame on the port, whole or not at all. Never blocks: false if the payload is too
+// long or the tx ring has no room for the frame (counted in dropped).
+bool tm_send(tm_channel *tm, uint8_t id, const void *payload, int len);
+// text truncated to TM_MAX_PAYLOAD
+bool tm_log(tm_channel *tm, const char *text);
+
+static inline bool tm_send_sensor(tm_channel *tm, const tm_sensor *m)
+{
+    return tm_send(tm, TM_SENSOR, m, sizeof(*m));
+}
+
+static inline bool tm_send_motor(tm_channel *tm, const tm_motor *m)
+{
+    return tm_send(tm, TM_MOTOR, m, sizeof(*m));
+}
+
+// receiving side, fed with whatever arrives from the port
+typedef void (*tm_handler)(void *context, uint8_t id, uint8_t seq, const uint8_t *payload, int len);
+
+typedef struct {
+    uint8_t buf[TM_MAX_FRAME];
+    int len;
+    bool overflow;          // the current frame is longer than any valid one
+    int last_seq;           // -1 until the first frame
+    tm_handler handler;
+    void *context;
+    uint32_t frames;        // delivered to the handler
+    uint32_t crc_errors;
+    uint32_t framing_errors; // bad COBS, too short or too long
+    uint32_t lost;          // gaps in the sequence numbers
+} tm_decoder;
+
+void tm_decoder_init(tm_decoder *d, tm_handler handler, void *context);
+void tm_decode(tm_decoder *d, const uint8_t *data, int len);
+
+// building blocks, exposed for the tests
+uint16_t tm_crc16(const uint8_t *data, int len);
+// dst needs len + len / 254 + 1 bytes, returns the encoded length (no delimiter)
+int tm_cobs_encode(const uint8_t *src, int len, uint8_t *dst);
+// may decode in place (dst == src), returns the decoded length or -1 if the input is not valid COBS
+int tm_cobs_decode(const uint8_t *src, int len, uint8_t *dst);
+
+#endif //UART_IRQ_TELEMETRY_H
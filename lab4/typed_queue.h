@@ -0,0 +1,78 @@
+//
+// Typed lock-free single-producer / single-consumer queue.
+//
+
+#ifndef UART_IRQ_TYPED_QUEUE_H
+#define UART_IRQ_TYPED_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// The element-typed sibling of ring_buffer, for events and records instead of bytes.
+// TYPED_QUEUE(name, type, size) defines the type name_t and static inline functions
+//   name_init(q)                        empty the queue
+//   name_try_add(q, &item)              false if the queue is full
+//   name_try_remove(q, &item)           false if the queue is empty
+//   name_remove_batch(q, items, max)    remove up to max items, returns the number removed
+//   name_count(q)
+// with the same semantics as the pico queue_try_add/queue_try_remove, but without the
+// spin lock: one producer (for example a GPIO callback) and one consumer (the main loop)
+// may use a queue concurrently. Size must be a power of two and is a compile time constant,
+// so wrapping is a constant mask. Declare instances static to place them in .bss.
+//
+//   TYPED_QUEUE(encoder_queue, encoder_event_t, 16)
+//   static encoder_queue_t events;
+#define TYPED_QUEUE(name, type, size) \
+    _Static_assert((size) > 0 && ((size) & ((size) - 1)) == 0, #name " size must be a power of two"); \
+    typedef struct { \
+        _Atomic uint32_t head; \
+        _Atomic uint32_t tail; \
+        type items[(size)]; \
+    } name##_t; \
+    \
+    static inline void name##_init(name##_t *q) \
+    { \
+        atomic_init(&q->head, 0); \
+        atomic_init(&q->tail, 0); \
+    } \
+    \
+    static inline int name##_count(name##_t *q) \
+    { \
+        return (int) (atomic_load_explicit(&q->head, memory_order_acquire) - \
+                      atomic_load_explicit(&q->tail, memory_order_acquire)); \
+    } \
+    \
+    static inline bool name##_try_add(name##_t *q, const type *item) \
+    { \
+        uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed); \
+        uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire); \
+        if(head - tail >= (size)) return false; \
+        q->items[head & ((size) - 1)] = *item; \
+        atomic_store_explicit(&q->head, head + 1, memory_order_release); \
+        return true; \
+    } \
+    \
+    static inline bool name##_try_remove(name##_t *q, type *item) \
+    { \
+        uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
+        uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire); \
+        if(head == tail) return false; \
+        *item = q->items[tail & ((size) - 1)]; \
+        atomic_store_explicit(&q->tail, tail + 1, memory_order_release); \
+        return true; \
+    } \
+    \
+    static inline int name##_remove_batch(name##_t *q, type *items, int max) \
+    { \
+        uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed); \
+        uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire); \
+        int count = (int) (head - tail) < max ? (int) (head - tail) : max; \
+        for(int i = 0; i < count; ++i) { \
+            items[i] = q->items[(tail + i) & ((size) - 1)]; \
+        } \
+        atomic_store_explicit(&q->tail, tail + count, memory_order_release); \
+        return count; \
+    }
+
+#endif //UART_IRQ_TYPED_QUEUE_H
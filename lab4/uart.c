@@ -1,94 +1,113 @@
 
 #include <string.h>
-#include "pico/stdlib.h"
-#include "hardware/uart.h"
-#include "ring_buffer.h"
+#include "uart_port.h"
 
 #include "uart.h"
 
-typedef struct {
-    ring_buffer tx;
-    ring_buffer rx;
-    uart_inst_t *uart;
-    int irqn;
-    irq_handler_t handler;
-} uart_t;
-
-void uart_irq_rx(uart_t *u);
-void uart_irq_tx(uart_t *u);
-void uart0_handler(void);
-void uart1_handler(void);
-
-static uart_t *uart_get_handle(int uart_nr);
-
-static uart_t u0 = { .uart = uart0, .irqn = UART0_IRQ, .handler = uart0_handler };
-static uart_t u1 = { .uart = uart1, .irqn = UART1_IRQ, .handler = uart1_handler };
-
-static uart_t *uart_get_handle(int uart_nr) {
-    return uart_nr ? &u1 : &u0;
+static uart_port *uart_get_handle(int uart_nr) {
+    return uart_nr >= 0 && uart_nr < uart_port_count ? uart_ports[uart_nr] : NULL;
 }
 
 
 void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed)
 {
-    uart_t *uart = uart_get_handle(uart_nr);
+    uart_port *uart = uart_get_handle(uart_nr);
+    if(!uart) return;
+
+    // ensure that we don't get any interrupts from the port during configuration
+    uart->backend->stop(uart);
+
+    // ring buffers are statically allocated, just discard any old contents
+    rb_init(&uart->rx, uart->rx.buffer, rb_capacity(&uart->rx));
+    rb_init(&uart->tx, uart->tx.buffer, rb_capacity(&uart->tx));
+    rx_wait_init(&uart->rxw);
+    memset(&uart->stats, 0, sizeof(uart->stats));
+    uart->stats.isr_cycles_min = UINT32_MAX;
+    uart->isr_cycles = 0;
+    uart->flow = false;
+    if(uart->line_mode) ld_init(&uart->ld, &uart->rx);
+
+    uart->backend->setup(uart, tx_pin, rx_pin, speed);
+}
 
-    // ensure that we don't get any interrupts from the uart during configuration
-    irq_set_enabled(uart->irqn, false);
+// Assert RTS again once reads have drained the rx ring. RTS goes first: if the receive
+// interrupt comes in between, it sees rts_ready still false and the next one deasserts again.
+static void uart_rx_consumed(uart_port *u)
+{
+    if(u->flow && !u->rts_ready && rb_count(&u->rx) <= u->flow_low) {
+        u->backend->set_rts(u, true);
+        u->rts_ready = true;
+    }
+}
 
-    // allocate space for ring buffers
-    rb_alloc(&uart->rx, 256);
-    rb_alloc(&uart->tx, 256);
+int uart_read(int uart_nr, uint8_t *buffer, int size)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    if(!u) return 0;
+    int count = rb_read(&u->rx, buffer, size);
+    uart_rx_consumed(u);
+    return count;
+}
 
-    // Set up our UART with the required speed.
-    uart_init(uart->uart, speed);
+bool uart_wait_readable(int uart_nr, uint32_t timeout_us)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    return u && rx_wait_readable(&u->rxw, &u->rx, timeout_us);
+}
 
-    // Set the TX and RX pins by using the function select on the GPIO
-    // See datasheet for more information on function select
-    gpio_set_function(tx_pin, GPIO_FUNC_UART);
-    gpio_set_function(rx_pin, GPIO_FUNC_UART);
+int uart_read_until(int uart_nr, uint8_t *buffer, int size, int delim, uint32_t timeout_us)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    if(!u) {
+        if(size > 0) buffer[0] = '\0';
+        return 0;
+    }
+    int count = rx_wait_read_until(&u->rxw, &u->rx, buffer, size, delim, timeout_us);
+    uart_rx_consumed(u);
+    return count;
+}
 
-    irq_set_exclusive_handler(uart->irqn, uart->handler);
+void uart_set_line_mode(int uart_nr, bool enable)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    if(!u) return;
+    u->line_mode = false;
+    // the interrupts only look at ld once line_mode is set
+    if(enable) {
+        ld_init(&u->ld, &u->rx);
+        u->line_mode = true;
+    }
+}
 
-    // Now enable the UART to send interrupts - RX only
-    uart_set_irq_enables(uart->uart, true, false);
-    // enable UART0 interrupts on NVIC
-    irq_set_enabled(uart->irqn, true);
+static bool uart_line_ready(void *arg)
+{
+    return ld_count(arg) > 0;
 }
 
-int uart_read(int uart_nr, uint8_t *buffer, int size)
+bool uart_wait_line(int uart_nr, uint32_t timeout_us)
 {
-    int count = 0;
-    uart_t *u = uart_get_handle(uart_nr);
-    while(count < size && !rb_empty(&u->rx)) {
-        *buffer++ = rb_get(&u->rx);
-        ++count;
-    }
-    return count;
+    uart_port *u = uart_get_handle(uart_nr);
+    return u && u->line_mode && rx_wait_for(&u->rxw, uart_line_ready, &u->ld, timeout_us);
+}
+
+int uart_read_line(int uart_nr, uint8_t *buffer, int size, uint32_t timeout_us, uint64_t *time_us)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    if(!u || !u->line_mode || !rx_wait_for(&u->rxw, uart_line_ready, &u->ld, timeout_us)) return -1;
+    int len = ld_read(&u->ld, buffer, size, time_us);
+    uart_rx_consumed(u);
+    return len;
 }
 
 int uart_write(int uart_nr, const uint8_t *buffer, int size)
 {
-    int count = 0;
-    uart_t *u = uart_get_handle(uart_nr);
+    uart_port *u = uart_get_handle(uart_nr);
+    if(!u) return 0;
     // write data to ring buffer
-    while(count < size && !rb_full(&u->tx)) {
-        rb_put(&u->tx, *buffer++);
-        ++count;
-    }
-    // disable interrupts on NVIC while managing transmit interrupts
-    irq_set_enabled(u->irqn, false);
-
-    // if transmit interrupt is not enabled we need to enable it and give fifo an initial filling
-    if(!(uart_get_hw(u->uart)->imsc & (1 << UART_UARTIMSC_TXIM_LSB))) {
-        // enable transmit interrupt
-        uart_set_irq_enables(u->uart, true, true);
-        // fifo requires initial filling
-        uart_irq_tx(u);
-    }
-
-    // enable interrupts on NVIC
-    irq_set_enabled(u->irqn, true);
+    int count = rb_write(&u->tx, buffer, size);
+    if(count < size) ++u->stats.tx_stalls;
+    // no-op if the port is already transmitting, it picks up the data we just queued
+    u->backend->tx_kick(u);
 
     return count;
 }
@@ -98,36 +117,92 @@ int uart_send(int uart_nr, const char *str)
     return uart_write(uart_nr, (const uint8_t *)str, strlen(str));
 }
 
+int uart_tx_free(int uart_nr)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    return u ? rb_capacity(&u->tx) - rb_count(&u->tx) : 0;
+}
 
-void uart_irq_rx(uart_t *u)
+int uart_set_speed(int uart_nr, int speed)
 {
-    while(uart_is_readable(u->uart)) {
-        uint8_t c = uart_getc(u->uart);
-        // ignoring return value for now
-        rb_put(&u->rx, c);
-    }
+    uart_port *u = uart_get_handle(uart_nr);
+    return u ? u->backend->set_speed(u, speed) : 0;
 }
 
-void uart_irq_tx(uart_t *u)
+bool uart_set_flow_control(int uart_nr, int cts_pin, int rts_pin)
 {
-    while(!rb_empty(&u->tx) && uart_is_writable(u->uart)) {
-        uart_get_hw(u->uart)->dr = rb_get((&u->tx));
+    uart_port *u = uart_get_handle(uart_nr);
+    if(!u || !u->backend->set_flow) return false;
+    u->flow = false;
+    if(!u->backend->set_flow(u, cts_pin, rts_pin)) return false;
+    if(rts_pin >= 0) {
+        int capacity = rb_capacity(&u->rx);
+        u->flow_high = capacity - capacity / 4;
+        u->flow_low = capacity / 4;
+        u->rts_ready = true;
+        u->flow = true;
     }
+    return true;
+}
+
+int uart_count(void)
+{
+    return uart_port_count;
+}
 
-    if (rb_empty(&u->tx)) {
-        // disable tx interrupt if transmit buffer is empty
-        uart_set_irq_enables(u->uart, true, false);
+void uart_get_stats(int uart_nr, uart_stats *stats)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    if(!u) {
+        memset(stats, 0, sizeof(*stats));
+        return;
     }
+    *stats = u->stats;
+    // head counts every byte published to the rx ring and tail every byte taken from the
+    // tx ring by the hardware, both since uart_setup
+    stats->rx_bytes = atomic_load(&u->rx.head) + u->rx.dropped;
+    stats->tx_bytes = atomic_load(&u->tx.tail);
+    stats->rx_dropped = u->rx.dropped + u->rx.overwritten;
+    if(stats->isr_calls == 0) stats->isr_cycles_min = 0;
+    else stats->isr_cycles_avg = (uint32_t) (u->isr_cycles / stats->isr_calls);
+}
+
+void uart_get_buffer_stats(int uart_nr, rb_stats *rx, rb_stats *tx)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    if(!u) return;
+    if(rx) rb_get_stats(&u->rx, rx);
+    if(tx) rb_get_stats(&u->tx, tx);
+}
+
+void uart_set_rx_watermark(int uart_nr, int high, rb_watermark_cb cb, void *context)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    if(u) rb_set_watermarks(&u->rx, -1, high, cb, context);
+}
+
+void uart_set_tx_watermark(int uart_nr, int low, rb_watermark_cb cb, void *context)
+{
+    uart_port *u = uart_get_handle(uart_nr);
+    if(u) rb_set_watermarks(&u->tx, low, -1, cb, context);
 }
 
-void uart0_handler(void)
+
+void uart_rx_published(uart_port *u, uint64_t time_us)
 {
-    uart_irq_rx(&u0);
-    uart_irq_tx(&u0);
+    if(u->flow && u->rts_ready && rb_count(&u->rx) >= u->flow_high) {
+        u->rts_ready = false;
+        u->backend->set_rts(u, false);
+        ++u->stats.rts_deasserts;
+    }
+    if(u->line_mode) ld_scan(&u->ld, time_us);
+    rx_wait_signal(&u->rxw);
 }
 
-void uart1_handler(void)
+void uart_isr_cycles(uart_port *u, uint32_t cycles)
 {
-    uart_irq_rx(&u1);
-    uart_irq_tx(&u1);
+    ++u->stats.isr_calls;
+    u->isr_cycles += cycles;
+    if(cycles < u->stats.isr_cycles_min) u->stats.isr_cycles_min = cycles;
+    if(cycles > u->stats.isr_cycles_max) u->stats.isr_cycles_max = cycles;
 }
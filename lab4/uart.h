@@ -5,10 +5,68 @@
 #ifndef UART_IRQ_UART_H
 #define UART_IRQ_UART_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring_buffer.h"
 
+// Per-port driver counters since uart_setup. Byte counts wrap at 2^32.
+typedef struct {
+    uint32_t rx_bytes;          // received, including bytes the rx ring lost
+    uint32_t tx_bytes;          // handed to the hardware
+    uint32_t overrun;           // hardware error flags (OE/BE/PE/FE), one count per interrupt
+    uint32_t breaks;            // that saw the flag; PIO ports only detect framing errors
+    uint32_t parity;
+    uint32_t framing;
+    uint32_t rx_dropped;        // bytes lost in the rx ring (full, or overwritten before read)
+    uint32_t tx_stalls;         // uart_write calls that found the tx ring full
+    uint32_t rts_deasserts;     // times flow control held the peer off (rx ring 3/4 full)
+    uint32_t cts_stalls;        // times the peer held us off (CTS deasserted, hardware ports)
+    uint32_t isr_calls;         // receive/transmit interrupt handler runs for this port
+    uint32_t isr_cycles_min;    // and their length in CPU cycles (0 on the host)
+    uint32_t isr_cycles_avg;
+    uint32_t isr_cycles_max;
+} uart_stats;
+
+// uart_nr indexes the port table in uart_ports.c, calls with an unknown number do nothing
 void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed);
 int uart_read(int uart_nr, uint8_t *buffer, int size);
 int uart_write(int uart_nr, const uint8_t *buffer, int size);
 int uart_send(int uart_nr, const char *str);
+// free space in the tx ring: a write of up to this many bytes is taken whole
+int uart_tx_free(int uart_nr);
+// sleep (__wfe) until received data is available or timeout_us passes, true if data is available
+bool uart_wait_readable(int uart_nr, uint32_t timeout_us);
+// read until delim (stored), until size - 1 bytes are stored or until timeout_us passes,
+// sleeping while no data is available. buffer is NUL terminated, returns the number of bytes stored.
+int uart_read_until(int uart_nr, uint8_t *buffer, int size, int delim, uint32_t timeout_us);
+// Line mode: the receive interrupt records where each line (ending in LF, CR LF included)
+// ends, so uart_read_line gets a whole line without searching for it. Data received before
+// line mode was enabled is skipped. Do not mix with uart_read / uart_read_until.
+void uart_set_line_mode(int uart_nr, bool enable);
+// copy the next complete line to buffer, waiting up to timeout_us for one. buffer is NUL
+// terminated, longer lines are truncated. Returns the length, -1 if there is no line.
+// If time_us is not NULL it receives when the line's LF arrived (time_us_64 clock), taken by
+// the receive interrupt rather than when the caller got around to reading it.
+int uart_read_line(int uart_nr, uint8_t *buffer, int size, uint32_t timeout_us, uint64_t *time_us);
+// sleep until a complete line is waiting or timeout_us passes, true if there is one
+bool uart_wait_line(int uart_nr, uint32_t timeout_us);
+// change the speed of a port that is set up, after the data already written has been sent.
+// Returns the speed actually set (hardware dividers round it), 0 for an unknown port.
+int uart_set_speed(int uart_nr, int speed);
+// Flow control, call after uart_setup (which turns it off). RTS (rts_pin, active low) is
+// deasserted from the receive interrupt when the rx ring is 3/4 full and asserted again once
+// reads drain it to 1/4; CTS (cts_pin) pauses transmission while the peer deasserts it.
+// -1 leaves a signal unused. Returns false if the port cannot do it (PIO ports: RTS only).
+bool uart_set_flow_control(int uart_nr, int cts_pin, int rts_pin);
+// number of ports in the table
+int uart_count(void);
+// driver counters, see uart_stats
+void uart_get_stats(int uart_nr, uart_stats *stats);
+// ring buffer occupancy and loss figures for tuning buffer sizes
+void uart_get_buffer_stats(int uart_nr, rb_stats *rx, rb_stats *tx);
+// callback (from the UART interrupt) when received data reaches high bytes / queued transmit
+// data drains to low bytes, a negative level disables it. Call after uart_setup.
+void uart_set_rx_watermark(int uart_nr, int high, rb_watermark_cb cb, void *context);
+void uart_set_tx_watermark(int uart_nr, int low, rb_watermark_cb cb, void *context);
 
 #endif //UART_IRQ_UART_H
@@ -0,0 +1,91 @@
+//
+// DMA transfer state machines for the UART driver, independent of the hardware.
+//
+#include "uart_dma.h"
+
+void tx_dma_init(tx_dma *t, ring_buffer *rb, dma_start_fn start, void *context)
+{
+    t->rb = rb;
+    t->start = start;
+    t->context = context;
+    atomic_init(&t->in_flight, 0);
+    t->transfers = 0;
+}
+
+void tx_dma_kick(tx_dma *t)
+{
+    const uint8_t *span;
+    // common case while transmitting: one load and done
+    if(atomic_load_explicit(&t->in_flight, memory_order_acquire)) return;
+
+    int count = rb_peek_read(t->rb, &span);
+    if(count > 0) {
+        // mark busy before starting so the completion interrupt always sees the span length
+        atomic_store_explicit(&t->in_flight, count, memory_order_release);
+        ++t->transfers;
+        t->start(t->context, span, count);
+    }
+}
+
+void tx_dma_complete(tx_dma *t)
+{
+    rb_consume(t->rb, atomic_load_explicit(&t->in_flight, memory_order_relaxed));
+    atomic_store_explicit(&t->in_flight, 0, memory_order_release);
+    tx_dma_kick(t);
+}
+
+bool tx_dma_busy(tx_dma *t)
+{
+    return atomic_load_explicit(&t->in_flight, memory_order_acquire) != 0;
+}
+
+static uint32_t rx_dma_written(void *context)
+{
+    return rx_dma_position(context);
+}
+
+void rx_dma_init(rx_dma *r, ring_buffer *rb, const volatile uint32_t *remaining, uint32_t run)
+{
+    r->rb = rb;
+    r->remaining = remaining;
+    r->run = run;
+    r->seen = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    r->seen_us = 0;
+    atomic_init(&r->completed, r->seen);
+    rb_set_write_position(rb, rx_dma_written, r);
+}
+
+uint32_t rx_dma_position(rx_dma *r)
+{
+    uint32_t completed, remaining;
+    // a restart between the two loads changes completed, read both again
+    do {
+        completed = atomic_load_explicit(&r->completed, memory_order_acquire);
+        remaining = *r->remaining;
+    } while(completed != atomic_load_explicit(&r->completed, memory_order_acquire));
+    return completed + (r->run - remaining);
+}
+
+void rx_dma_restarted(rx_dma *r)
+{
+    // only the DMA interrupt writes completed, and the M0+ has no atomic read-modify-write
+    uint32_t completed = atomic_load_explicit(&r->completed, memory_order_relaxed);
+    atomic_store_explicit(&r->completed, completed + r->run, memory_order_release);
+}
+
+int rx_dma_tick(rx_dma *r, uint64_t now_us, uint64_t *time_us)
+{
+    uint32_t position = rx_dma_position(r);
+    uint32_t pending = position - atomic_load_explicit(&r->rb->head, memory_order_relaxed);
+    bool idle = position == r->seen;
+    if(!idle) {
+        r->seen = position;
+        r->seen_us = now_us;
+    }
+    // still receiving: leave the line in one piece unless it is getting long
+    if(pending == 0 || (!idle && pending < (uint32_t) rb_capacity(r->rb) / 4)) return 0;
+    // the bytes are already in place, only the index has to move
+    rb_commit_write(r->rb, (int) pending);
+    *time_us = r->seen_us;
+    return (int) pending;
+}
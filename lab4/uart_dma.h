@@ -0,0 +1,70 @@
+//
+// DMA transfer state machines for the UART driver, independent of the hardware.
+//
+
+#ifndef UART_IRQ_UART_DMA_H
+#define UART_IRQ_UART_DMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring_buffer.h"
+
+// hands a span of the ring buffer storage to the DMA channel
+typedef void (*dma_start_fn)(void *context, const uint8_t *src, int len);
+
+// Transmit: the DMA channel reads contiguous spans straight out of the TX ring buffer.
+// Only one span is in flight at a time, its bytes stay in the ring until the transfer
+// completes, so the writer can keep appending behind it.
+typedef struct {
+    ring_buffer *rb;
+    dma_start_fn start;
+    void *context;
+    _Atomic int in_flight;      // bytes handed to the DMA channel, 0 when idle
+    uint32_t transfers;
+} tx_dma;
+
+void tx_dma_init(tx_dma *t, ring_buffer *rb, dma_start_fn start, void *context);
+// start the next span if the channel is idle. Called by the writer after queuing data and
+// from tx_dma_complete. No interrupt masking is needed as long as the writer and the
+// completion interrupt run on the same core: the writer can only see in_flight == 0 while
+// no transfer is running, and then no completion can preempt it before it starts one.
+// If in_flight is set, the running transfer's completion picks up the newly queued data.
+void tx_dma_kick(tx_dma *t);
+// DMA completion interrupt: release the finished span and chain the next one
+void tx_dma_complete(tx_dma *t);
+bool tx_dma_busy(tx_dma *t);
+
+// Receive: a DMA channel writes into the RX ring storage on its own, wrapping at the ring
+// size, and never waits for an interrupt: one run is RX_DMA_RUN transfers (about four days
+// at 115200 baud) and only the end of a run needs the completion interrupt to restart it.
+// The remaining transfer count gives the channel's free running write position, so the
+// ring's intact window follows the channel exactly (see rb_set_write_position) and no
+// amount of interrupt latency can make it overrun the UART fifo. head is moved up to the
+// channel by rx_dma_tick, which the driver runs from a periodic timer. The ring must be in
+// overwrite-oldest mode.
+#define RX_DMA_RUN 0xffffffffu
+
+typedef struct {
+    ring_buffer *rb;
+    const volatile uint32_t *remaining; // the channel's live transfer count
+    uint32_t run;                       // transfers per run the channel was started with
+    _Atomic uint32_t completed;         // transfers of the finished runs, free running
+    uint32_t seen;                      // write position at the previous tick
+    uint64_t seen_us;                   // time of the tick that first saw the channel at seen
+} rx_dma;
+
+// the channel is started at the ring's head with run transfers; installs the ring's write
+// position hook
+void rx_dma_init(rx_dma *r, ring_buffer *rb, const volatile uint32_t *remaining, uint32_t run);
+// free running ring index the channel writes next, safe from any context
+uint32_t rx_dma_position(rx_dma *r);
+// completion interrupt, after restarting the channel for another run
+void rx_dma_restarted(rx_dma *r);
+// Periodic tick at now_us: publish what the channel has written once no byte came in since
+// the previous tick (the line went idle) or once a quarter ring is waiting. Returns the
+// number of bytes published and stores in *time_us when the newest of them arrived, as
+// the time of the tick that first saw it: at most one tick period late, however long the
+// tick itself was held up after that.
+int rx_dma_tick(rx_dma *r, uint64_t now_us, uint64_t *time_us);
+
+#endif //UART_IRQ_UART_DMA_H
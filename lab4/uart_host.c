@@ -0,0 +1,68 @@
+//
+// Host backend for the UART dispatcher: ports backed by memory instead of hardware.
+//
+#include "uart_host.h"
+
+static uart_host_state *host_state(uart_port *u)
+{
+    return u->state;
+}
+
+static void uart_host_stop(uart_port *u)
+{
+}
+
+static void uart_host_setup(uart_port *u, int tx_pin, int rx_pin, int speed)
+{
+    host_state(u)->transmitted = 0;
+    host_state(u)->speed = speed;
+}
+
+// "transmit" everything queued at once
+static void uart_host_tx_kick(uart_port *u)
+{
+    uart_host_state *s = host_state(u);
+    const uint8_t *span;
+    int n;
+    while((n = rb_peek_read(&u->tx, &span)) > 0) {
+        if(s->sink) s->sink(s->context, span, n);
+        s->transmitted += n;
+        rb_consume(&u->tx, n);
+    }
+}
+
+static int uart_host_set_speed(uart_port *u, int speed)
+{
+    // tx_kick has already sent everything
+    host_state(u)->speed = speed;
+    return speed;
+}
+
+static bool uart_host_set_flow(uart_port *u, int cts_pin, int rts_pin)
+{
+    host_state(u)->rts = true;
+    return true;
+}
+
+static void uart_host_set_rts(uart_port *u, bool ready)
+{
+    host_state(u)->rts = ready;
+}
+
+const uart_backend uart_host_backend = {
+    .stop = uart_host_stop,
+    .setup = uart_host_setup,
+    .tx_kick = uart_host_tx_kick,
+    .set_speed = uart_host_set_speed,
+    .set_flow = uart_host_set_flow,
+    .set_rts = uart_host_set_rts,
+};
+
+int uart_host_receive(int uart_nr, const uint8_t *data, int len)
+{
+    if(uart_nr < 0 || uart_nr >= uart_port_count) return 0;
+    uart_port *u = uart_ports[uart_nr];
+    int count = rb_write(&u->rx, data, len);
+    if(count > 0) uart_rx_published(u, uart_time_us());
+    return count;
+}
@@ -0,0 +1,35 @@
+//
+// Host backend for the UART dispatcher: ports backed by memory instead of hardware.
+//
+
+#ifndef UART_IRQ_UART_HOST_H
+#define UART_IRQ_UART_HOST_H
+
+#include "uart_port.h"
+
+// called with everything written to the port, in order
+typedef void (*uart_host_sink)(void *context, const uint8_t *data, int len);
+
+typedef struct {
+    uart_host_sink sink;
+    void *context;
+    uint32_t transmitted;
+    int speed;          // as passed to uart_setup / uart_set_speed
+    bool rts;           // RTS level set by flow control, true while ready to receive
+} uart_host_state;
+
+extern const uart_backend uart_host_backend;
+
+// port whose transmitted data goes to sink (may be NULL) and which receives what is passed
+// to uart_host_receive
+#define UART_HOST_PORT(name, rx_size, tx_size, sink_, context_) \
+    RB_STORAGE(name##_rx_buf, rx_size); \
+    RB_STORAGE(name##_tx_buf, tx_size); \
+    static uart_host_state name##_state = { .sink = (sink_), .context = (context_) }; \
+    static uart_port name = UART_PORT_INIT(name##_rx_buf, name##_tx_buf, &uart_host_backend, &name##_state)
+
+// deliver received bytes to port uart_nr the way a receive interrupt would, returns the
+// number of bytes that fitted in the rx ring
+int uart_host_receive(int uart_nr, const uint8_t *data, int len);
+
+#endif //UART_IRQ_UART_HOST_H
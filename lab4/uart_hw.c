@@ -0,0 +1,255 @@
+//
+// RP2040 hardware UART backend: DMA in both directions, see uart_dma.h.
+//
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "hardware/dma.h"
+#include "uart_hw.h"
+
+void uart0_handler(void);
+void uart1_handler(void);
+void uart_dma_handler(void);
+
+// port set up on each hardware UART, for the interrupt handlers
+static uart_port *hw_ports[2];
+
+static uart_hw_state *hw_state(uart_port *u)
+{
+    return u->state;
+}
+
+static int hw_irqn(uart_hw_state *s)
+{
+    return UART0_IRQ + uart_get_index(s->uart);
+}
+
+static void uart_dma_start(void *context, const uint8_t *src, int len)
+{
+    uart_hw_state *s = context;
+    dma_channel_transfer_from_buffer_now(s->dma_tx, src, len);
+}
+
+// RX tick: publish what the DMA has written once the line goes idle, stamped with the tick
+// that first saw the last byte (within 32 bit times of its arrival)
+static bool uart_hw_tick(repeating_timer_t *rt)
+{
+    uart_port *u = rt->user_data;
+    uint32_t start = uart_cycles();
+    uint64_t time_us;
+    if(rx_dma_tick(&hw_state(u)->rxd, uart_time_us(), &time_us) > 0) uart_rx_published(u, time_us);
+    uart_isr_cycles(u, uart_cycles_since(start));
+    return true;
+}
+
+// (re)start the RX tick at 32 bit times for baud. It runs on the default alarm pool, which
+// must belong to the core that calls uart_setup: the tick is the rx ring's producer.
+static void uart_hw_start_tick(uart_port *u, uint32_t baud)
+{
+    uart_hw_state *s = hw_state(u);
+    if(s->ticking) cancel_repeating_timer(&s->rx_tick);
+    s->tick_us = 32 * 1000000 / baud;
+    if(s->tick_us < UART_HW_TICK_MIN_US) s->tick_us = UART_HW_TICK_MIN_US;
+    s->ticking = add_repeating_timer_us(-(int64_t) s->tick_us, uart_hw_tick, u, &s->rx_tick);
+}
+
+static void uart_dma_stop_channel(int channel)
+{
+    // stop the running transfer without letting it complete into the handler
+    dma_channel_set_irq0_enabled(channel, false);
+    dma_channel_abort(channel);
+    dma_channel_acknowledge_irq0(channel);
+}
+
+static void uart_hw_stop(uart_port *u)
+{
+    uart_hw_state *s = hw_state(u);
+
+    irq_set_enabled(hw_irqn(s), false);
+    if(s->ticking) cancel_repeating_timer(&s->rx_tick);
+    s->ticking = false;
+    // claim the channels on first use, otherwise stop them before the ring buffers are reset
+    if(s->dma_tx < 0) s->dma_tx = dma_claim_unused_channel(true);
+    else uart_dma_stop_channel(s->dma_tx);
+    if(s->dma_rx < 0) s->dma_rx = dma_claim_unused_channel(true);
+    else uart_dma_stop_channel(s->dma_rx);
+}
+
+static void uart_dma_start_channels(uart_port *u)
+{
+    static bool handler_installed = false;
+    uart_hw_state *s = hw_state(u);
+
+    // TX: byte transfers from the ring buffer to the data register, paced by the UART TX DREQ
+    dma_channel_config c = dma_channel_get_default_config(s->dma_tx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(s->uart, true));
+    dma_channel_configure(s->dma_tx, &c, &uart_get_hw(s->uart)->dr, NULL, 0, false);
+    tx_dma_init(&s->txd, &u->tx, uart_dma_start, s);
+
+    // RX: byte transfers from the data register into the rx ring storage, the write address
+    // wraps at the ring size. Runs until RX_DMA_RUN bytes have been received.
+    c = dma_channel_get_default_config(s->dma_rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, __builtin_ctz(rb_capacity(&u->rx)));
+    channel_config_set_dreq(&c, uart_get_dreq(s->uart, false));
+    dma_channel_configure(s->dma_rx, &c, u->rx.buffer, &uart_get_hw(s->uart)->dr, RX_DMA_RUN, false);
+    rx_dma_init(&s->rxd, &u->rx, &dma_channel_hw_addr(s->dma_rx)->transfer_count, RX_DMA_RUN);
+
+    if(!handler_installed) {
+        irq_add_shared_handler(DMA_IRQ_0, uart_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        handler_installed = true;
+    }
+    dma_channel_set_irq0_enabled(s->dma_tx, true);
+    dma_channel_set_irq0_enabled(s->dma_rx, true);
+    irq_set_enabled(DMA_IRQ_0, true);
+    dma_channel_start(s->dma_rx);
+}
+
+static void uart_hw_setup(uart_port *u, int tx_pin, int rx_pin, int speed)
+{
+    uart_hw_state *s = hw_state(u);
+    int index = uart_get_index(s->uart);
+
+    // Receive DMA never stops, so the rx ring overwrites the oldest data if it is not read in time.
+    rb_set_overwrite(&u->rx, true);
+    hw_ports[index] = u;
+    uart_cycles_init();
+
+    // Set up our UART with the required speed.
+    // uart_init also enables the UART DMA requests
+    uint32_t baud = uart_init(s->uart, speed);
+    uart_dma_start_channels(u);
+    uart_hw_start_tick(u, baud);
+
+    // Set the TX and RX pins by using the function select on the GPIO
+    // See datasheet for more information on function select
+    gpio_set_function(tx_pin, GPIO_FUNC_UART);
+    gpio_set_function(rx_pin, GPIO_FUNC_UART);
+
+    irq_set_exclusive_handler(hw_irqn(s), index ? uart1_handler : uart0_handler);
+
+    // Now enable the UART to send interrupts - receive errors only, DMA moves the data and the
+    // RX tick publishes it (the RX timeout never fires, DMA keeps the fifo empty)
+    uart_get_hw(s->uart)->imsc = UART_UARTIMSC_OEIM_BITS | UART_UARTIMSC_BEIM_BITS |
+                                 UART_UARTIMSC_PEIM_BITS | UART_UARTIMSC_FEIM_BITS;
+    // enable UART interrupts on NVIC
+    irq_set_enabled(hw_irqn(s), true);
+}
+
+static bool uart_hw_set_flow(uart_port *u, int cts_pin, int rts_pin)
+{
+    uart_hw_state *s = hw_state(u);
+    uart_hw_t *hw = uart_get_hw(s->uart);
+
+    // CTS gates the transmitter in hardware, its changes are counted by the UART interrupt
+    if(cts_pin >= 0) gpio_set_function(cts_pin, GPIO_FUNC_UART);
+    uart_set_hw_flow(s->uart, cts_pin >= 0, false);
+    if(cts_pin >= 0) hw_set_bits(&hw->imsc, UART_UARTIMSC_CTSMIM_BITS);
+    else hw_clear_bits(&hw->imsc, UART_UARTIMSC_CTSMIM_BITS);
+
+    // Hardware RTS only deasserts when the RX fifo fills, which the RX DMA never lets happen,
+    // so RTS is a GPIO that follows the rx ring instead
+    if(rts_pin >= 0) {
+        gpio_init(rts_pin);
+        gpio_put(rts_pin, 0);   // active low: ready
+        gpio_set_dir(rts_pin, GPIO_OUT);
+    }
+    s->rts_pin = rts_pin;
+    return true;
+}
+
+static void uart_hw_set_rts(uart_port *u, bool ready)
+{
+    gpio_put(hw_state(u)->rts_pin, !ready);
+}
+
+static void uart_hw_tx_kick(uart_port *u)
+{
+    // no-op if a transfer is running, its completion chains the data just queued.
+    // Safe without masking the DMA interrupt, see tx_dma_kick (call from the core that
+    // called uart_setup, which is where the DMA interrupt runs)
+    tx_dma_kick(&hw_state(u)->txd);
+}
+
+static int uart_hw_set_speed(uart_port *u, int speed)
+{
+    uart_hw_state *s = hw_state(u);
+    // the DMA empties the tx ring, then the fifo and shift register drain
+    while(!rb_empty(&u->tx) || tx_dma_busy(&s->txd)) tight_loop_contents();
+    uart_tx_wait_blocking(s->uart);
+    uint32_t baud = uart_set_baudrate(s->uart, speed);
+    uart_hw_start_tick(u, baud);
+    return (int) baud;
+}
+
+const uart_backend uart_hw_backend = {
+    .stop = uart_hw_stop,
+    .setup = uart_hw_setup,
+    .tx_kick = uart_hw_tx_kick,
+    .set_speed = uart_hw_set_speed,
+    .set_flow = uart_hw_set_flow,
+    .set_rts = uart_hw_set_rts,
+};
+
+
+static void uart_irq_rx(uart_port *u)
+{
+    uint32_t start = uart_cycles();
+    uart_hw_t *hw = uart_get_hw(hw_state(u)->uart);
+    uint32_t mis = hw->mis;
+
+    // The DMA reads the data register 8 bits at a time, so the error bits stored with each
+    // character are lost; the error interrupts report them instead
+    if(mis & UART_UARTMIS_OEMIS_BITS) ++u->stats.overrun;
+    if(mis & UART_UARTMIS_BEMIS_BITS) ++u->stats.breaks;
+    if(mis & UART_UARTMIS_PEMIS_BITS) ++u->stats.parity;
+    if(mis & UART_UARTMIS_FEMIS_BITS) ++u->stats.framing;
+    // CTS changed, count it when the peer stops us
+    if((mis & UART_UARTMIS_CTSMMIS_BITS) && !(hw->fr & UART_UARTFR_CTS_BITS)) ++u->stats.cts_stalls;
+    if(mis & (UART_UARTMIS_OEMIS_BITS | UART_UARTMIS_BEMIS_BITS | UART_UARTMIS_PEMIS_BITS | UART_UARTMIS_FEMIS_BITS)) {
+        // writing rsr clears the sticky error status
+        hw->rsr = 0;
+    }
+    hw->icr = UART_UARTICR_OEIC_BITS | UART_UARTICR_BEIC_BITS | UART_UARTICR_PEIC_BITS |
+              UART_UARTICR_FEIC_BITS | UART_UARTICR_CTSMIC_BITS;
+    uart_isr_cycles(u, uart_cycles_since(start));
+}
+
+void uart0_handler(void)
+{
+    uart_irq_rx(hw_ports[0]);
+}
+
+void uart1_handler(void)
+{
+    uart_irq_rx(hw_ports[1]);
+}
+
+// shared DMA_IRQ_0 handler: a finished TX span re-arms the channel with the next one,
+// a finished RX run (every RX_DMA_RUN bytes) is restarted where it stopped
+void uart_dma_handler(void)
+{
+    for(int i = 0; i < 2; ++i) {
+        uart_port *u = hw_ports[i];
+        if(!u) continue;
+        uart_hw_state *s = hw_state(u);
+        uint32_t start = uart_cycles();
+        bool serviced = false;
+        if(dma_channel_get_irq0_status(s->dma_tx)) {
+            dma_channel_acknowledge_irq0(s->dma_tx);
+            tx_dma_complete(&s->txd);
+            serviced = true;
+        }
+        if(dma_channel_get_irq0_status(s->dma_rx)) {
+            dma_channel_acknowledge_irq0(s->dma_rx);
+            dma_channel_set_trans_count(s->dma_rx, RX_DMA_RUN, true);
+            rx_dma_restarted(&s->rxd);
+            serviced = true;
+        }
+        if(serviced) uart_isr_cycles(u, uart_cycles_since(start));
+    }
+}
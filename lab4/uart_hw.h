@@ -0,0 +1,39 @@
+//
+// RP2040 hardware UART backend: DMA in both directions, see uart_dma.h.
+//
+
+#ifndef UART_IRQ_UART_HW_H
+#define UART_IRQ_UART_HW_H
+
+#include "pico/time.h"
+#include "hardware/uart.h"
+#include "uart_port.h"
+#include "uart_dma.h"
+
+// shortest RX tick period, for high speeds where 32 bit times would be a very busy timer
+#ifndef UART_HW_TICK_MIN_US
+#define UART_HW_TICK_MIN_US 100
+#endif
+
+typedef struct {
+    uart_inst_t *uart;
+    int dma_tx;         // DMA channel feeding the TX fifo, -1 until claimed
+    int dma_rx;         // DMA channel draining the RX fifo into the rx ring, -1 until claimed
+    int rts_pin;        // GPIO driven as RTS, -1 without flow control
+    uint32_t tick_us;   // RX tick period, 32 bit times: the line is idle after a tick without data
+    bool ticking;
+    repeating_timer_t rx_tick;
+    tx_dma txd;
+    rx_dma rxd;
+} uart_hw_state;
+
+extern const uart_backend uart_hw_backend;
+
+// port on hardware UART n (0 or 1), ring sizes must be powers of two
+#define UART_HW_PORT(name, n, rx_size, tx_size) \
+    RB_STORAGE_DMA(name##_rx_buf, rx_size); \
+    RB_STORAGE(name##_tx_buf, tx_size); \
+    static uart_hw_state name##_state = { .uart = uart##n, .dma_tx = -1, .dma_rx = -1, .rts_pin = -1 }; \
+    static uart_port name = UART_PORT_INIT(name##_rx_buf, name##_tx_buf, &uart_hw_backend, &name##_state)
+
+#endif //UART_IRQ_UART_HW_H
@@ -0,0 +1,176 @@
+//
+// PIO soft UART backend: one state machine per direction, interrupt driven.
+//
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
+#include "uart_pio.h"
+#include "uart_pio.pio.h"
+
+void uart_pio0_handler(void);
+void uart_pio1_handler(void);
+
+// ports set up so far, for the interrupt handlers
+static uart_port *pio_ports[UART_PIO_MAX_PORTS];
+
+static uart_pio_state *pio_state(uart_port *u)
+{
+    return u->state;
+}
+
+static int pio_irqn(PIO pio)
+{
+    return pio_get_index(pio) ? PIO1_IRQ_0 : PIO0_IRQ_0;
+}
+
+static void uart_pio_stop(uart_port *u)
+{
+    uart_pio_state *s = pio_state(u);
+
+    // the handler services every port on the block, keep it away from the rings being reset
+    s->running = false;
+    // claim the state machines on first use, otherwise stop them and their interrupts
+    if(s->sm_tx < 0) {
+        s->sm_tx = pio_claim_unused_sm(s->pio, true);
+        s->sm_rx = pio_claim_unused_sm(s->pio, true);
+        return;
+    }
+    pio_set_irq0_source_enabled(s->pio, pis_sm0_rx_fifo_not_empty + s->sm_rx, false);
+    pio_set_irq0_source_enabled(s->pio, pis_sm0_tx_fifo_not_full + s->sm_tx, false);
+    pio_sm_set_enabled(s->pio, s->sm_tx, false);
+    pio_sm_set_enabled(s->pio, s->sm_rx, false);
+}
+
+static void uart_pio_setup(uart_port *u, int tx_pin, int rx_pin, int speed)
+{
+    // program offsets per PIO block, both programs are loaded on first use
+    static int tx_offset[2] = { -1, -1 };
+    static int rx_offset[2] = { -1, -1 };
+    uart_pio_state *s = pio_state(u);
+    int index = pio_get_index(s->pio);
+
+    if(tx_offset[index] < 0) {
+        tx_offset[index] = (int) pio_add_program(s->pio, &uart_pio_tx_program);
+        rx_offset[index] = (int) pio_add_program(s->pio, &uart_pio_rx_program);
+        irq_add_shared_handler(pio_irqn(s->pio), index ? uart_pio1_handler : uart_pio0_handler,
+                               PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    }
+    for(int i = 0; i < UART_PIO_MAX_PORTS; ++i) {
+        if(pio_ports[i] == u) break;
+        if(!pio_ports[i]) {
+            pio_ports[i] = u;
+            break;
+        }
+    }
+
+    pio_sm_clear_fifos(s->pio, s->sm_tx);
+    pio_sm_clear_fifos(s->pio, s->sm_rx);
+    uart_pio_tx_program_init(s->pio, s->sm_tx, tx_offset[index], tx_pin, speed);
+    uart_pio_rx_program_init(s->pio, s->sm_rx, rx_offset[index], rx_pin, speed);
+    s->speed = speed;
+
+    uart_cycles_init();
+    // receive interrupt stays on, the transmit one only while there is data to send
+    s->running = true;
+    pio_set_irq0_source_enabled(s->pio, pis_sm0_rx_fifo_not_empty + s->sm_rx, true);
+    irq_set_enabled(pio_irqn(s->pio), true);
+}
+
+static void uart_pio_tx_kick(uart_port *u)
+{
+    uart_pio_state *s = pio_state(u);
+    // a single write to the interrupt enable set alias, the handler clears it again once
+    // the ring is empty. If it already did, the interrupt fires at once and finds our data.
+    pio_set_irq0_source_enabled(s->pio, pis_sm0_tx_fifo_not_full + s->sm_tx, true);
+}
+
+static int uart_pio_set_speed(uart_port *u, int speed)
+{
+    uart_pio_state *s = pio_state(u);
+    // the interrupt empties the ring into the fifo, then give the last byte time to shift out
+    while(!rb_empty(&u->tx) || !pio_sm_is_tx_fifo_empty(s->pio, s->sm_tx)) tight_loop_contents();
+    sleep_us(10 * 1000000 / s->speed + 1);
+
+    // both programs run 8 cycles per bit
+    float div = (float) clock_get_hz(clk_sys) / (8 * speed);
+    pio_sm_set_clkdiv(s->pio, s->sm_tx, div);
+    pio_sm_set_clkdiv(s->pio, s->sm_rx, div);
+    s->speed = speed;
+    return speed;
+}
+
+// RTS only, the transmit program does not watch a CTS pin
+static bool uart_pio_set_flow(uart_port *u, int cts_pin, int rts_pin)
+{
+    uart_pio_state *s = pio_state(u);
+    if(cts_pin >= 0) return false;
+    if(rts_pin >= 0) {
+        gpio_init(rts_pin);
+        gpio_put(rts_pin, 0);   // active low: ready
+        gpio_set_dir(rts_pin, GPIO_OUT);
+    }
+    s->rts_pin = rts_pin;
+    return true;
+}
+
+static void uart_pio_set_rts(uart_port *u, bool ready)
+{
+    gpio_put(pio_state(u)->rts_pin, !ready);
+}
+
+const uart_backend uart_pio_backend = {
+    .stop = uart_pio_stop,
+    .setup = uart_pio_setup,
+    .tx_kick = uart_pio_tx_kick,
+    .set_speed = uart_pio_set_speed,
+    .set_flow = uart_pio_set_flow,
+    .set_rts = uart_pio_set_rts,
+};
+
+
+static void uart_pio_irq(PIO pio)
+{
+    for(int i = 0; i < UART_PIO_MAX_PORTS && pio_ports[i]; ++i) {
+        uart_port *u = pio_ports[i];
+        uart_pio_state *s = pio_state(u);
+        if(s->pio != pio || !s->running) continue;
+        uint32_t start = uart_cycles();
+
+        // the rx program raises its relative flag 4 on a bad stop bit (framing error or break);
+        // it does not interrupt, so it is collected here
+        if(pio_interrupt_get(pio, 4 + s->sm_rx)) {
+            pio_interrupt_clear(pio, 4 + s->sm_rx);
+            ++u->stats.framing;
+        }
+
+        // receive: the byte is in the top 8 bits of the fifo word
+        bool received = false;
+        while(!pio_sm_is_rx_fifo_empty(pio, s->sm_rx)) {
+            rb_put(&u->rx, (uint8_t) (pio_sm_get(pio, s->sm_rx) >> 24));
+            received = true;
+        }
+        if(received) uart_rx_published(u, uart_time_us());
+
+        // transmit: refill the fifo, stop the interrupt when the ring runs empty
+        bool sent = false;
+        while(!pio_sm_is_tx_fifo_full(pio, s->sm_tx) && !rb_empty(&u->tx)) {
+            pio_sm_put(pio, s->sm_tx, rb_get(&u->tx));
+            sent = true;
+        }
+        if(rb_empty(&u->tx)) {
+            pio_set_irq0_source_enabled(pio, pis_sm0_tx_fifo_not_full + s->sm_tx, false);
+        }
+        // the handler visits every port on the block, only time the ones it did work for
+        if(received || sent) uart_isr_cycles(u, uart_cycles_since(start));
+    }
+}
+
+void uart_pio0_handler(void)
+{
+    uart_pio_irq(pio0);
+}
+
+void uart_pio1_handler(void)
+{
+    uart_pio_irq(pio1);
+}
@@ -0,0 +1,32 @@
+//
+// PIO soft UART backend: one state machine per direction, interrupt driven.
+//
+
+#ifndef UART_IRQ_UART_PIO_H
+#define UART_IRQ_UART_PIO_H
+
+#include "hardware/pio.h"
+#include "uart_port.h"
+
+// PIO ports that can be set up at the same time (4 state machines per PIO block)
+#define UART_PIO_MAX_PORTS 4
+
+typedef struct {
+    PIO pio;
+    int sm_tx;          // state machines, -1 until claimed
+    int sm_rx;
+    volatile bool running;  // serviced by the interrupt handler
+    int speed;
+    int rts_pin;        // GPIO driven as RTS, -1 without flow control
+} uart_pio_state;
+
+extern const uart_backend uart_pio_backend;
+
+// port on PIO block pio_ (pio0 or pio1), ring sizes must be powers of two
+#define UART_PIO_PORT(name, pio_, rx_size, tx_size) \
+    RB_STORAGE(name##_rx_buf, rx_size); \
+    RB_STORAGE(name##_tx_buf, tx_size); \
+    static uart_pio_state name##_state = { .pio = pio_, .sm_tx = -1, .sm_rx = -1, .rts_pin = -1 }; \
+    static uart_port name = UART_PORT_INIT(name##_rx_buf, name##_tx_buf, &uart_pio_backend, &name##_state)
+
+#endif //UART_IRQ_UART_PIO_H
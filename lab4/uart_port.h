@@ -0,0 +1,115 @@
+//
+// UART port table and the interface between uart.c and the port backends.
+//
+
+#ifndef UART_IRQ_UART_PORT_H
+#define UART_IRQ_UART_PORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring_buffer.h"
+#include "rx_wait.h"
+#include "line_disc.h"
+#include "uart.h"
+
+#if PICO_ON_DEVICE
+#include "pico/time.h"
+#include "hardware/structs/systick.h"
+#else
+#include <time.h>
+#endif
+
+typedef struct uart_port uart_port;
+
+// A backend moves bytes between its hardware and the port's ring buffers from interrupts;
+// uart.c does everything else (reads, writes, waiting, line mode) the same for every port.
+typedef struct {
+    // stop interrupts and transfers, the ring buffers are reset next
+    void (*stop)(uart_port *u);
+    // configure the hardware and start receiving
+    void (*setup)(uart_port *u, int tx_pin, int rx_pin, int speed);
+    // data was added to u->tx: start transmitting if idle. Called without masking
+    // interrupts, so it must be safe against the backend's own transmit interrupt
+    void (*tx_kick)(uart_port *u);
+    // let queued data go out at the old speed, then switch, returns the actual speed
+    int (*set_speed)(uart_port *u, int speed);
+    // configure the flow control pins (-1 for none) with RTS asserted, false if not
+    // supported. NULL if the backend has no flow control.
+    bool (*set_flow)(uart_port *u, int cts_pin, int rts_pin);
+    // drive RTS: ready to receive or not
+    void (*set_rts)(uart_port *u, bool ready);
+} uart_backend;
+
+struct uart_port {
+    ring_buffer tx;
+    ring_buffer rx;
+    const uart_backend *backend;
+    void *state;                // backend specific, for example uart_hw_state
+    rx_wait rxw;                // uart_wait_readable / uart_read_until / uart_read_line sleep here
+    line_disc ld;               // line ends found by the receive interrupt in line mode
+    volatile bool line_mode;
+    volatile bool flow;         // RTS follows the rx ring level
+    volatile bool rts_ready;
+    int flow_high;              // rx ring levels where RTS is deasserted / asserted again
+    int flow_low;
+    uart_stats stats;           // error, stall and interrupt counters, the rest is filled in by uart_get_stats
+    uint64_t isr_cycles;        // total for the average
+};
+
+// port with statically allocated ring storage, see UART_HW_PORT / UART_PIO_PORT
+#define UART_PORT_INIT(rx_storage, tx_storage, backend_, state_) \
+    { .tx = RB_STATIC_INIT(tx_storage), .rx = RB_STATIC_INIT(rx_storage), .backend = (backend_), .state = (state_) }
+
+// The port table, uart_nr indexes it. Defined by the application (uart_ports.c in lab4):
+//   UART_HW_PORT(lora, 1, 256, 256);
+//   uart_port *const uart_ports[] = { &lora };
+//   const int uart_port_count = sizeof(uart_ports) / sizeof(uart_ports[0]);
+extern uart_port *const uart_ports[];
+extern const int uart_port_count;
+
+// for backends: call from the receive interrupt after publishing data to u->rx, time_us is
+// when the newest of the published bytes arrived (uart_time_us, corrected for any delay the
+// backend knows about)
+void uart_rx_published(uart_port *u, uint64_t time_us);
+// for backends: account one interrupt handler run that took cycles
+void uart_isr_cycles(uart_port *u, uint32_t cycles);
+
+// receive time stamps: time_us_64 on the device, the monotonic clock on the host
+#if PICO_ON_DEVICE
+static inline uint64_t uart_time_us(void)
+{
+    return time_us_64();
+}
+#else
+static inline uint64_t uart_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
+#if PICO_ON_DEVICE
+// The M0+ has no cycle counter, so interrupt handlers are timed with SysTick running free
+// as a 24 bit down counter at the CPU clock. Started by the backends unless already in use.
+static inline void uart_cycles_init(void)
+{
+    if(!(systick_hw->csr & M0PLUS_SYST_CSR_ENABLE_BITS)) {
+        systick_hw->rvr = 0xffffff;
+        systick_hw->cvr = 0;
+        systick_hw->csr = M0PLUS_SYST_CSR_ENABLE_BITS | M0PLUS_SYST_CSR_CLKSOURCE_BITS;
+    }
+}
+
+static inline uint32_t uart_cycles(void)
+{
+    return systick_hw->cvr;
+}
+
+static inline uint32_t uart_cycles_since(uint32_t start)
+{
+    return (start - systick_hw->cvr) & 0xffffff;
+}
+#endif
+
+#endif //UART_IRQ_UART_PORT_H
@@ -0,0 +1,29 @@
+//
+// UART port table: uart_nr in the uart_* calls indexes uart_ports.
+// Add or remove ports here; pins and speed are chosen at uart_setup.
+//
+#include "uart_hw.h"
+#include "uart_pio.h"
+
+// ring buffer sizes of the hardware ports, override with target_compile_definitions
+// (must be powers of two)
+#ifndef UART0_RX_SIZE
+#define UART0_RX_SIZE 256
+#endif
+#ifndef UART0_TX_SIZE
+#define UART0_TX_SIZE 256
+#endif
+#ifndef UART1_RX_SIZE
+#define UART1_RX_SIZE 256
+#endif
+#ifndef UART1_TX_SIZE
+#define UART1_TX_SIZE 256
+#endif
+
+UART_HW_PORT(u0, 0, UART0_RX_SIZE, UART0_TX_SIZE);     // port 0: UART0
+UART_HW_PORT(u1, 1, UART1_RX_SIZE, UART1_TX_SIZE);     // port 1: UART1 (LoRa module)
+UART_PIO_PORT(p0, pio0, 256, 256);                     // port 2: PIO0 soft UART
+UART_PIO_PORT(p1, pio0, 256, 256);                     // port 3: PIO0 soft UART
+
+uart_port *const uart_ports[] = { &u0, &u1, &p0, &p1 };
+const int uart_port_count = sizeof(uart_ports) / sizeof(uart_ports[0]);
@@ -0,0 +1,157 @@
+//
+// POSIX tty backend for the UART dispatcher: a pty, a USB serial adapter or any tty path.
+//
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <termios.h>
+#include <unistd.h>
+#include "uart_posix.h"
+
+static uart_posix_state *posix_state(uart_port *u)
+{
+    return u->state;
+}
+
+static speed_t posix_speed(int speed)
+{
+    switch(speed) {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B9600;
+    }
+}
+
+static void posix_configure(uart_posix_state *s, int speed)
+{
+    struct termios t;
+    // a pty accepts any speed and ignores it
+    if(tcgetattr(s->fd, &t) != 0) return;
+    cfmakeraw(&t);
+    t.c_cflag |= CLOCAL | CREAD;
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+    cfsetispeed(&t, posix_speed(speed));
+    cfsetospeed(&t, posix_speed(speed));
+    tcsetattr(s->fd, TCSANOW, &t);
+}
+
+// receive side of the "interrupt": publish what arrived, counting what did not fit
+static bool posix_receive(uart_port *u, int fd)
+{
+    uint8_t buf[256];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if(n <= 0) return n < 0 && (errno == EAGAIN || errno == EINTR);
+    if(rb_write(&u->rx, buf, (int) n) > 0) uart_rx_published(u, uart_time_us());
+    return true;
+}
+
+// transmit side: write out as much of the tx ring as the tty takes
+static bool posix_transmit(uart_port *u, int fd)
+{
+    const uint8_t *span;
+    int n;
+    while((n = rb_peek_read(&u->tx, &span)) > 0) {
+        ssize_t written = write(fd, span, n);
+        if(written < 0) return errno == EAGAIN || errno == EINTR;
+        rb_consume(&u->tx, (int) written);
+        if(written < n) break;
+    }
+    return true;
+}
+
+static void *posix_thread(void *arg)
+{
+    uart_port *u = arg;
+    uart_posix_state *s = posix_state(u);
+    struct pollfd fds[2] = { { .fd = s->fd }, { .fd = s->wake[0], .events = POLLIN } };
+
+    while(!atomic_load(&s->stopping)) {
+        fds[0].events = POLLIN | (rb_empty(&u->tx) ? 0 : POLLOUT);
+        if(poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        if(fds[1].revents & POLLIN) {
+            uint8_t drain[16];
+            // clear the flag first, a kick after this point writes the pipe again
+            atomic_store(&s->kicked, false);
+            while(read(s->wake[0], drain, sizeof(drain)) > 0) { }
+        }
+        if((fds[0].revents & POLLIN) && !posix_receive(u, s->fd)) break;
+        // the other end of a pty went away
+        if(fds[0].revents & (POLLHUP | POLLERR) && !(fds[0].revents & POLLIN)) break;
+        if(!rb_empty(&u->tx) && !posix_transmit(u, s->fd)) break;
+    }
+    return NULL;
+}
+
+static void uart_posix_stop(uart_port *u)
+{
+    uart_posix_state *s = posix_state(u);
+    if(s->fd < 0) return;
+
+    atomic_store(&s->stopping, true);
+    if(write(s->wake[1], "", 1) < 0) { }
+    pthread_join(s->thread, NULL);
+    close(s->wake[0]);
+    close(s->wake[1]);
+    close(s->fd);
+    s->fd = -1;
+}
+
+static void uart_posix_setup(uart_port *u, int tx_pin, int rx_pin, int speed)
+{
+    uart_posix_state *s = posix_state(u);
+
+    if(!s->path || (s->fd = open(s->path, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) return;
+    posix_configure(s, speed);
+    s->speed = speed;
+    if(pipe(s->wake) != 0) {
+        close(s->fd);
+        s->fd = -1;
+        return;
+    }
+    fcntl(s->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(s->wake[1], F_SETFL, O_NONBLOCK);
+    atomic_store(&s->kicked, false);
+    atomic_store(&s->stopping, false);
+    pthread_create(&s->thread, NULL, posix_thread, u);
+}
+
+static void uart_posix_tx_kick(uart_port *u)
+{
+    uart_posix_state *s = posix_state(u);
+    // one system call per burst of writes at most
+    if(s->fd >= 0 && !atomic_exchange(&s->kicked, true)) {
+        if(write(s->wake[1], "", 1) < 0) { }
+    }
+}
+
+static int uart_posix_set_speed(uart_port *u, int speed)
+{
+    uart_posix_state *s = posix_state(u);
+    if(s->fd < 0) return 0;
+    // let the thread write out what is queued, then the tty drain it at the old speed
+    while(!rb_empty(&u->tx)) sched_yield();
+    tcdrain(s->fd);
+    posix_configure(s, speed);
+    s->speed = speed;
+    return speed;
+}
+
+const uart_backend uart_posix_backend = {
+    .stop = uart_posix_stop,
+    .setup = uart_posix_setup,
+    .tx_kick = uart_posix_tx_kick,
+    .set_speed = uart_posix_set_speed,
+    .set_flow = NULL,
+    .set_rts = NULL,
+};
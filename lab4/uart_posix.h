@@ -0,0 +1,34 @@
+//
+// POSIX tty backend for the UART dispatcher: a pty, a USB serial adapter or any tty path.
+//
+
+#ifndef UART_IRQ_UART_POSIX_H
+#define UART_IRQ_UART_POSIX_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "uart_port.h"
+
+// The tty is put in raw mode at the speed given to uart_setup. A thread stands in for the
+// interrupt handlers: it moves received bytes into the rx ring (signalling readers as the
+// receive interrupt does) and writes the tx ring out whenever uart_write kicks it.
+typedef struct {
+    const char *path;           // tty to open at uart_setup, set before calling it
+    int fd;                     // -1 while closed
+    int wake[2];                // pipe that kicks the thread
+    atomic_bool kicked;         // a kick is already pending, no need to write the pipe again
+    atomic_bool stopping;
+    pthread_t thread;
+    int speed;
+} uart_posix_state;
+
+extern const uart_backend uart_posix_backend;
+
+// port on the tty at path_ (may be NULL and set in name##_state.path before uart_setup)
+#define UART_POSIX_PORT(name, path_, rx_size, tx_size) \
+    RB_STORAGE(name##_rx_buf, rx_size); \
+    RB_STORAGE(name##_tx_buf, tx_size); \
+    static uart_posix_state name##_state = { .path = (path_), .fd = -1 }; \
+    static uart_port name = UART_PORT_INIT(name##_rx_buf, name##_tx_buf, &uart_posix_backend, &name##_state)
+
+#endif //UART_IRQ_UART_POSIX_H
@@ -0,0 +1,80 @@
+//
+// stdio driver on a lab4 UART port: printf returns as soon as the text is in the tx ring.
+//
+#include "pico/stdlib.h"
+#include "pico/stdio/driver.h"
+#include "uart.h"
+#include "uart_stdio.h"
+
+static int stdio_uart = -1;
+static volatile uart_stdio_policy stdio_policy;
+static volatile uint32_t stdio_dropped;
+static volatile uint32_t stdio_irq_dropped;     // by interrupt handlers, which can nest
+
+static void uart_stdio_out_chars(const char *buf, int len)
+{
+    // The tx ring has a single producer, the main loop. A handler writing to it could
+    // preempt rb_write or the DMA kick halfway, so output from interrupts is dropped.
+    if(__get_current_exception() != 0) {
+        if(stdio_policy == UART_STDIO_DROP_COUNT) {
+            uint32_t save = save_and_disable_interrupts();
+            stdio_irq_dropped += len;
+            restore_interrupts(save);
+        }
+        return;
+    }
+    while(len > 0) {
+        int n = uart_write(stdio_uart, (const uint8_t *) buf, len);
+        buf += n;
+        len -= n;
+        if(len == 0) break;
+        if(stdio_policy != UART_STDIO_BLOCK) {
+            if(stdio_policy == UART_STDIO_DROP_COUNT) stdio_dropped += len;
+            break;
+        }
+        while(uart_tx_free(stdio_uart) == 0) tight_loop_contents();
+    }
+}
+
+// wait until the tx ring has been handed to the hardware
+static void uart_stdio_out_flush(void)
+{
+    rb_stats tx;
+    if(__get_current_exception() != 0) return;
+    uart_get_buffer_stats(stdio_uart, NULL, &tx);
+    while(uart_tx_free(stdio_uart) < tx.capacity) tight_loop_contents();
+}
+
+static int uart_stdio_in_chars(char *buf, int len)
+{
+    // the rx ring has a single consumer as well
+    if(__get_current_exception() != 0) return PICO_ERROR_NO_DATA;
+    int n = uart_read(stdio_uart, (uint8_t *) buf, len);
+    return n > 0 ? n : PICO_ERROR_NO_DATA;
+}
+
+static stdio_driver_t uart_stdio_driver = {
+    .out_chars = uart_stdio_out_chars,
+    .out_flush = uart_stdio_out_flush,
+    .in_chars = uart_stdio_in_chars,
+    .crlf_enabled = PICO_STDIO_DEFAULT_CRLF,
+};
+
+void uart_stdio_init(int uart_nr, uart_stdio_policy policy)
+{
+    stdio_policy = policy;
+    stdio_dropped = 0;
+    stdio_irq_dropped = 0;
+    stdio_uart = uart_nr;
+    stdio_set_driver_enabled(&uart_stdio_driver, true);
+}
+
+void uart_stdio_set_policy(uart_stdio_policy policy)
+{
+    stdio_policy = policy;
+}
+
+uint32_t uart_stdio_dropped(void)
+{
+    return stdio_dropped + stdio_irq_dropped;
+}
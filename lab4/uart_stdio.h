@@ -0,0 +1,26 @@
+//
+// stdio driver on a lab4 UART port: printf returns as soon as the text is in the tx ring.
+//
+
+#ifndef UART_IRQ_UART_STDIO_H
+#define UART_IRQ_UART_STDIO_H
+
+#include <stdint.h>
+
+// what printf does when the tx ring is full
+typedef enum {
+    UART_STDIO_BLOCK,       // wait for the port to drain
+    UART_STDIO_DROP,        // discard what does not fit
+    UART_STDIO_DROP_COUNT,  // discard and count the bytes, see uart_stdio_dropped
+} uart_stdio_policy;
+
+// Route stdout/stdin through port uart_nr, which must already be set up with uart_setup.
+// Disable the SDK UART stdio (pico_enable_stdio_uart(... 0)) when using its UART here.
+// Only thread code (not interrupt handlers) may print: output from a handler is discarded
+// whatever the policy, counted under UART_STDIO_DROP_COUNT, and input reads nothing.
+void uart_stdio_init(int uart_nr, uart_stdio_policy policy);
+void uart_stdio_set_policy(uart_stdio_policy policy);
+// bytes discarded under UART_STDIO_DROP_COUNT
+uint32_t uart_stdio_dropped(void);
+
+#endif //UART_IRQ_UART_STDIO_H